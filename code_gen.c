@@ -16,6 +16,7 @@
  *****************************************************************************/
 
 #include <limits.h>
+#include "my-ctype.h"
 
 #include "ast.h"
 #include "exceptions.h"
@@ -240,6 +241,19 @@ add_fixup(enum fixup_kind kind, unsigned value, State * state)
     return add_linked_fixup(kind, value, -1, state);
 }
 
+static int
+is_identifier(const char *s)
+{
+    const unsigned char *p = (const unsigned char *) s;
+
+    if (!isalpha(*p) && *p != '_')
+	return 0;
+    while (*++p)
+	if (!isalnum(*p) && *p != '_')
+	    return 0;
+    return 1;
+}
+
 static void
 add_literal(Var v, State * state)
 {
@@ -270,11 +284,16 @@ add_literal(Var v, State * state)
 	    gstate->max_literals = new_max;
 	}
 	if (v.type == TYPE_STR) {
-	    /* intern string if we can */
+	    /* intern string if we can; anything that could be written as
+	     * a property or verb name goes in the permanent name table
+	     */
 	    Var nv;
 
 	    nv.type = TYPE_STR;
-	    nv.v.str = str_intern(v.v.str);
+	    if (is_identifier(v.v.str))
+		nv.v.str = str_intern_name(v.v.str);
+	    else
+		nv.v.str = str_intern(v.v.str);
 	    gstate->literals[i = gstate->num_literals++] = nv;
 	} else {
 	    gstate->literals[i = gstate->num_literals++] = var_ref(v);
@@ -38,6 +38,13 @@ extern int db_initialize(int *pargc, char ***pargv);
 				 * database args were valid.
 				 */
 
+extern int db_set_dump_format(const char *format);
+				/* Chooses the format of database dumps,
+				 * "text" or "binary", returning false if
+				 * FORMAT is neither.  By default, they're in
+				 * the format of the database loaded.
+				 */
+
 extern int db_load(void);
 				/* Does any necessary long-running preparations
 				 * of the database, such as loading significant
@@ -127,6 +134,11 @@ extern void db_set_object_name(Objid oid, const char *name);
 
 extern Objid db_object_parent(Objid);
 extern int db_count_children(Objid);
+extern Var db_object_children(Objid);
+				/* Returns a new reference to a list of the
+				 * children, in order; it is shared with other
+				 * callers until the children change.
+				 */
 extern int db_for_all_children(Objid,
 			       int (*)(void *, Objid),
 			       void *);
@@ -138,6 +150,18 @@ extern int db_for_all_children(Objid,
 				 *      db_renumber_object()
 				 *      db_change_parent()
 				 */
+extern int db_object_isa(Objid oid, Objid ancestor);
+				/* Returns true iff ANCESTOR is OID or one of
+				 * OID's ancestors.  Both must be valid.
+				 */
+extern int db_count_descendants(Objid);
+extern int db_for_all_descendants(Objid,
+				  int (*)(void *, Objid),
+				  void *);
+				/* Visits each object before its own children,
+				 * the children in order.  The same caveats
+				 * apply as for db_for_all_children().
+				 */
 extern int db_change_parent(Objid oid, Objid parent);
 				/* db_change_parent() returns true (and
 				 * actually changes the parent of OID) iff
@@ -149,6 +173,21 @@ extern int db_change_parent(Objid oid, Objid parent);
 
 extern Objid db_object_location(Objid);
 extern int db_count_contents(Objid);
+extern Var db_object_contents(Objid);
+				/* Likewise, for the contents. */
+typedef struct {
+    const char *name;
+    Objid oid;
+} db_name_entry;
+
+extern const db_name_entry *db_contents_names(Objid oid, int *count);
+				/* Returns a vector of *COUNT entries, one for
+				 * the name of each of the contents of OID and
+				 * one for each string in its `aliases'
+				 * property, sorted by mystrcasecmp() on the
+				 * name.  The vector is only good until the
+				 * next change to the database.
+				 */
 extern int db_for_all_contents(Objid,
 			       int (*)(void *, Objid),
 			       void *);
@@ -315,6 +354,13 @@ extern db_prop_handle db_find_property(Objid oid, const char *name,
 				 * leave the handle intact.
 				 */
 
+extern db_prop_handle db_find_property_hashed(Objid oid, const char *name,
+					      unsigned hash, Var * value);
+				/* As db_find_property(), for callers that
+				 * already have str_hash(NAME) to hand (e.g.,
+				 * from str_hash_memo()).
+				 */
+
 extern Var db_property_value(db_prop_handle);
 extern void db_set_property_value(db_prop_handle, Var);
 				/* For non-built-in properties, these functions
@@ -466,6 +512,13 @@ extern db_verb_handle db_find_callable_verb(Objid oid, const char *verb);
 				 * leave the handle intact.
 				 */
 
+extern db_verb_handle db_find_callable_verb_hashed(Objid oid,
+						   const char *verb,
+						   unsigned hash);
+				/* As db_find_callable_verb(), given
+				 * str_hash(VERB).
+				 */
+
 extern db_verb_handle db_find_defined_verb(Objid oid, const char *verb,
 					   int allow_numbers);
 				/* Returns a handle on the first verb found
@@ -23,6 +23,7 @@
 #include "my-unistd.h"
 #include "my-stdio.h"
 #include "my-stdlib.h"
+#include "my-string.h"
 
 #include "config.h"
 #include "db.h"
@@ -44,6 +45,12 @@ static char *input_db_name, *dump_db_name;
 static int dump_generation = 0;
 static const char *header_format_string
 = "** LambdaMOO Database, Format Version %u **\n";
+static const char *binary_header_format_string
+= "** LambdaMOO Binary Database, Format Version %u **\n";
+static const char *binary_header_prefix
+= "** LambdaMOO Binary Database, Format Version ";
+
+static int binary_dump = -1;	/* -1 means the same as the input DB */
 
 DB_Version dbio_input_version;
 
@@ -53,7 +60,9 @@ DB_Version dbio_input_version;
 static void
 read_verbdef(Verbdef * v)
 {
-    v->name = dbio_read_string_intern();
+    v->name = str_intern_name(dbio_read_string());
+    v->matcher = 0;
+    dbpriv_set_verb_matcher(v);
     v->owner = dbio_read_objid();
     v->perms = dbio_read_num();
     v->prep = dbio_read_num();
@@ -73,8 +82,7 @@ write_verbdef(Verbdef * v)
 static Propdef
 read_propdef()
 {
-    const char *name = dbio_read_string_intern();
-    return dbpriv_new_propdef(name);
+    return dbpriv_new_propdef(dbio_read_string());
 }
 
 static void
@@ -102,44 +110,38 @@ write_propval(Pval * p)
 
 /*********** Object I/O ***********/
 
-static int
-read_object(void)
+/* In a text DB each object starts with a `#<number>' line, which says
+ * instead `#<number> recycled' if that's all there is to it.  In a
+ * binary DB each is a record (see dbpriv_begin_dbio_record()), empty for
+ * a recycled object.
+ */
+
+static void
+read_object_body(Objid oid)
 {
-    Objid oid;
     Object *o;
-    char s[20];
     int i;
     Verbdef *v, **prevv;
     int nprops;
 
-    if (dbio_scanf("#%d", &oid) != 1 || oid != db_last_used_objid() + 1)
-	return 0;
-    dbio_read_line(s, sizeof(s));
-
-    if (strcmp(s, " recycled\n") == 0) {
-	dbpriv_new_recycled_object();
-	return 1;
-    } else if (strcmp(s, "\n") != 0)
-	return 0;
-
     o = dbpriv_new_object();
     o->name = dbio_read_string_intern();
     (void) dbio_read_string();	/* discard old handles string */
-    o->flags = dbio_read_num();
+    obj_flags(oid) = dbio_read_num();
 
-    o->owner = dbio_read_objid();
+    obj_owner(oid) = dbio_read_objid();
 
-    o->location = dbio_read_objid();
+    obj_location(oid) = dbio_read_objid();
     o->contents = dbio_read_objid();
     o->next = dbio_read_objid();
 
-    o->parent = dbio_read_objid();
+    obj_parent(oid) = dbio_read_objid();
     o->child = dbio_read_objid();
     o->sibling = dbio_read_objid();
 
     o->verbdefs = 0;
     prevv = &(o->verbdefs);
-    for (i = dbio_read_num(); i > 0; i--) {
+    for (i = dbpriv_dbio_read_count(); i > 0; i--) {
 	v = mymalloc(sizeof(Verbdef), M_VERBDEF);
 	read_verbdef(v);
 	*prevv = v;
@@ -149,14 +151,14 @@ read_object(void)
     o->propdefs.cur_length = 0;
     o->propdefs.max_length = 0;
     o->propdefs.l = 0;
-    if ((i = dbio_read_num()) != 0) {
+    if ((i = dbpriv_dbio_read_count()) != 0) {
 	o->propdefs.l = mymalloc(i * sizeof(Propdef), M_PROPDEF);
 	o->propdefs.cur_length = i;
 	o->propdefs.max_length = i;
 	for (i = 0; i < o->propdefs.cur_length; i++)
 	    o->propdefs.l[i] = read_propdef();
     }
-    nprops = dbio_read_num();
+    nprops = dbpriv_dbio_read_count();
     if (nprops)
 	o->propval = mymalloc(nprops * sizeof(Pval), M_PVAL);
     else
@@ -165,36 +167,63 @@ read_object(void)
     for (i = 0; i < nprops; i++) {
 	read_propval(o->propval + i);
     }
+}
 
-    return 1;
+static int
+read_object(void)
+{
+    Objid oid;
+    char s[20];
+
+    if (dbio_scanf("#%d", &oid) != 1 || oid != db_last_used_objid() + 1)
+	return 0;
+    dbio_read_line(s, sizeof(s));
+
+    if (strcmp(s, " recycled\n") == 0) {
+	dbpriv_new_recycled_object();
+	return 1;
+    } else if (strcmp(s, "\n") != 0)
+	return 0;
+
+    read_object_body(oid);
+    return !dbpriv_dbio_input_failed();
+}
+
+static int
+read_binary_object(void)
+{
+    int len = dbpriv_dbio_read_count();
+    long start = dbpriv_dbio_input_pos();
+
+    if (len == 0)
+	dbpriv_new_recycled_object();
+    else
+	read_object_body(db_last_used_objid() + 1);
+
+    return (!dbpriv_dbio_input_failed()
+	    && dbpriv_dbio_input_pos() - start == len);
 }
 
 static void
-write_object(Objid oid)
+write_object_body(Objid oid)
 {
-    Object *o;
+    Object *o = dbpriv_find_object(oid);
     Verbdef *v;
+    Objid a;
     int i;
     int nverbdefs, nprops;
 
-    if (!valid(oid)) {
-	dbio_printf("#%d recycled\n", oid);
-	return;
-    }
-    o = dbpriv_find_object(oid);
-
-    dbio_printf("#%d\n", oid);
     dbio_write_string(o->name);
     dbio_write_string("");	/* placeholder for old handles string */
-    dbio_write_num(o->flags);
+    dbio_write_num(obj_flags(oid));
 
-    dbio_write_objid(o->owner);
+    dbio_write_objid(obj_owner(oid));
 
-    dbio_write_objid(o->location);
+    dbio_write_objid(obj_location(oid));
     dbio_write_objid(o->contents);
     dbio_write_objid(o->next);
 
-    dbio_write_objid(o->parent);
+    dbio_write_objid(obj_parent(oid));
     dbio_write_objid(o->child);
     dbio_write_objid(o->sibling);
 
@@ -212,8 +241,35 @@ write_object(Objid oid)
     nprops = dbpriv_count_properties(oid);
 
     dbio_write_num(nprops);
-    for (i = 0; i < nprops; i++)
+    for (i = 0; i < o->propdefs.cur_length; i++)
 	write_propval(o->propval + i);
+    for (a = obj_parent(oid); a != NOTHING; a = obj_parent(a))
+	for (i = 0; i < dbpriv_find_object(a)->propdefs.cur_length; i++) {
+	    Pval pv;
+
+	    pv = dbpriv_propval(oid, a, i);
+	    write_propval(&pv);
+	}
+}
+
+static void
+write_object(Objid oid)
+{
+    if (!valid(oid)) {
+	dbio_printf("#%d recycled\n", oid);
+	return;
+    }
+    dbio_printf("#%d\n", oid);
+    write_object_body(oid);
+}
+
+static void
+write_binary_object(Objid oid)
+{
+    dbpriv_begin_dbio_record();
+    if (valid(oid))
+	write_object_body(oid);
+    dbpriv_end_dbio_record();
 }
 
 
@@ -236,32 +292,35 @@ validate_hierarchies()
 	}							\
     }
 
+#   define sibling_of(oid)	(dbpriv_find_object(oid)->sibling)
+#   define next_of(oid)		(dbpriv_find_object(oid)->next)
+
     oklog("VALIDATE: Phase 1: Check for invalid objects ...\n");
     for (oid = 0; oid < size; oid++) {
 	Object *o = dbpriv_find_object(oid);
 
 	MAYBE_LOG_PROGRESS;
 	if (o) {
-	    if (o->location == NOTHING && o->next != NOTHING) {
+	    if (obj_location(oid) == NOTHING && o->next != NOTHING) {
 		o->next = NOTHING;
 		fixed_nexts++;
 	    }
 #	    define CHECK(field, name) 					\
 	    {								\
-	        if (o->field != NOTHING					\
-		    && !dbpriv_find_object(o->field)) {			\
+	        if (field != NOTHING					\
+		    && !dbpriv_find_object(field)) {			\
 		    errlog("VALIDATE: #%d.%s = #%d <invalid> ... fixed.\n", \
-			   oid, name, o->field);			\
-		    o->field = NOTHING;				  	\
+			   oid, name, field);				\
+		    field = NOTHING;				  	\
 		}							\
 	    }
 
-	    CHECK(parent, "parent");
-	    CHECK(child, "child");
-	    CHECK(sibling, "sibling");
-	    CHECK(location, "location");
-	    CHECK(contents, "contents");
-	    CHECK(next, "next");
+	    CHECK(obj_parent(oid), "parent");
+	    CHECK(o->child, "child");
+	    CHECK(o->sibling, "sibling");
+	    CHECK(obj_location(oid), "location");
+	    CHECK(o->contents, "contents");
+	    CHECK(o->next, "next");
 
 #	    undef CHECK
 	}
@@ -282,11 +341,11 @@ validate_hierarchies()
 		Objid slower = start;				\
 		Objid faster = slower;				\
 		while (faster != NOTHING) {			\
-		    faster = dbpriv_find_object(faster)->field;	\
+		    faster = field(faster);			\
 		    if (faster == NOTHING)			\
 			break;					\
-		    faster = dbpriv_find_object(faster)->field;	\
-		    slower = dbpriv_find_object(slower)->field;	\
+		    faster = field(faster);			\
+		    slower = field(slower);			\
 		    if (faster == slower) {			\
 			errlog("VALIDATE: Cycle in `%s' chain of #%d\n", \
 			       name, oid);			\
@@ -296,15 +355,15 @@ validate_hierarchies()
 		}						\
 	    }
 
-	    CHECK(o->parent, parent, "parent");
-	    CHECK(o->child, sibling, "child");
-	    CHECK(o->location, location, "location");
-	    CHECK(o->contents, next, "contents");
+	    CHECK(obj_parent(oid), obj_parent, "parent");
+	    CHECK(o->child, sibling_of, "child");
+	    CHECK(obj_location(oid), obj_location, "location");
+	    CHECK(o->contents, next_of, "contents");
 
 #	    undef CHECK
 
 	    /* setup for phase 3:  set two temp flags on every object */
-	    o->flags |= (3<<FLAG_FIRST_TEMP);
+	    obj_flags(oid) |= (3<<FLAG_FIRST_TEMP);
 	}
     }
 
@@ -320,14 +379,12 @@ validate_hierarchies()
 #	    define CHECK(up, down, down_name, across, FLAG)	\
 	    {							\
 		Objid	oidkid;					\
-		Object *okid;					\
 								\
 		for (oidkid = o->down;				\
 		     oidkid != NOTHING;				\
-		     oidkid = okid->across) {			\
+		     oidkid = across(oidkid)) {			\
 								\
-		    okid = dbpriv_find_object(oidkid);		\
-		    if (okid->up != oid) {			\
+		    if (up(oidkid) != oid) {			\
 			errlog(					\
 			    "VALIDATE: #%d erroneously on #%d's %s list.\n", \
 			    oidkid, oid, down_name);		\
@@ -335,13 +392,15 @@ validate_hierarchies()
 		    }						\
 		    else {					\
 			/* mark okid as properly claimed */	\
-			okid->flags &= ~(1<<(FLAG));		\
+			obj_flags(oidkid) &= ~(1<<(FLAG));	\
 		    }						\
 		}						\
 	    }
 
-	    CHECK(parent,   child,    "child",    sibling, FLAG_FIRST_TEMP);
-	    CHECK(location, contents, "contents", next,    FLAG_FIRST_TEMP+1);
+	    CHECK(obj_parent,   child,    "child",    sibling_of,
+		  FLAG_FIRST_TEMP);
+	    CHECK(obj_location, contents, "contents", next_of,
+		  FLAG_FIRST_TEMP+1);
 
 #	    undef CHECK
 	}
@@ -356,23 +415,26 @@ validate_hierarchies()
 #	    define CHECK(up, up_name, down_name, FLAG)			\
 	    {								\
 		/* If oid is unclaimed, up must be NOTHING */		\
-		if ((o->flags & (1<<(FLAG))) && o->up != NOTHING) {	\
+		if ((obj_flags(oid) & (1<<(FLAG))) && up(oid) != NOTHING) { \
 		    errlog("VALIDATE: #%d not in %s (#%d)'s %s list.\n", \
-			   oid, up_name, o->up, down_name);		\
+			   oid, up_name, up(oid), down_name);		\
 		    broken = 1;						\
 		}							\
 	    }
 
-	    CHECK(parent,   "parent",   "child",    FLAG_FIRST_TEMP);
-	    CHECK(location, "location", "contents", FLAG_FIRST_TEMP+1);
+	    CHECK(obj_parent,   "parent",   "child",    FLAG_FIRST_TEMP);
+	    CHECK(obj_location, "location", "contents", FLAG_FIRST_TEMP+1);
 
 	    /* clear temp flags */
-	    o->flags &= ~(3<<FLAG_FIRST_TEMP);
+	    obj_flags(oid) &= ~(3<<FLAG_FIRST_TEMP);
 
 #	    undef CHECK
 	}
     }
 
+#   undef sibling_of
+#   undef next_of
+
     oklog("VALIDATING the object hierarchies ... finished.\n");
     return !broken;
 }
@@ -390,6 +452,24 @@ fmt_verb_name(void *data)
     return reset_stream(s);
 }
 
+/* A binary DB has, after its header line, the offset of its object index
+ * in a fixed eight bytes; that index, following the objects, has the
+ * offset of each object's record.  It's checked here as the DB is read.
+ */
+
+static int
+read_object_index(long *offsets, int nobjs, long index_pos)
+{
+    int i;
+
+    if (dbpriv_dbio_input_pos() != index_pos)
+	return 0;
+    for (i = 0; i < nobjs; i++)
+	if (dbpriv_dbio_read_offset() != offsets[i])
+	    return 0;
+    return 1;
+}
+
 static int
 read_db_file(void)
 {
@@ -399,9 +479,23 @@ read_db_file(void)
     int i, vnum, dummy;
     db_verb_handle h;
     Program *program;
-
-    if (dbio_scanf(header_format_string, &dbio_input_version) != 1)
+    int binary = 0;
+    long index_pos = 0, *offsets = 0;
+    char c;
+
+    if (dbpriv_dbio_skip(binary_header_prefix)) {
+	if (dbio_scanf("%u **%c", &dbio_input_version, &c) != 2
+	    || c != '\n') {
+	    errlog("READ_DB_FILE: Bad header\n");
+	    return 0;
+	}
+	binary = 1;
+    } else if (dbio_scanf(header_format_string, &dbio_input_version) == 1)
+	binary = 0;
+    else
 	dbio_input_version = DBV_Prehistory;
+    if (binary_dump < 0)
+	binary_dump = binary;
 
     if (!check_db_version(dbio_input_version)) {
 	errlog("READ_DB_FILE: Unknown DB version number: %d\n",
@@ -414,8 +508,21 @@ read_db_file(void)
      * suppressed assignments are not counted in determining the returned value
      * of `scanf'...
      */
-    if (dbio_scanf("%d\n%d\n%d\n%d\n",
-		   &nobjs, &nprogs, &dummy, &nusers) != 4) {
+    if (binary) {
+	dbpriv_set_dbio_binary_input(1);
+	index_pos = dbpriv_dbio_read_fixed_offset();
+	nobjs = dbpriv_dbio_read_count();
+	nprogs = dbpriv_dbio_read_count();
+	nusers = dbpriv_dbio_read_count();
+	if (dbpriv_dbio_input_failed()) {
+	    errlog("READ_DB_FILE: Bad header\n");
+	    return 0;
+	}
+    } else if (dbio_scanf("%d\n%d\n%d\n%d\n",
+			  &nobjs, &nprogs, &dummy, &nusers) != 4
+	       || !dbpriv_dbio_count_fits(nobjs)
+	       || !dbpriv_dbio_count_fits(nprogs)
+	       || !dbpriv_dbio_count_fits(nusers)) {
 	errlog("READ_DB_FILE: Bad header\n");
 	return 0;
     }
@@ -427,22 +534,43 @@ read_db_file(void)
     dbpriv_set_all_users(user_list);
 
     oklog("LOADING: Reading %d objects...\n", nobjs);
+    if (binary)
+	offsets = mymalloc((nobjs + 1) * sizeof(long), M_OBJECT_TABLE);
     for (i = 1; i <= nobjs; i++) {
-	if (!read_object()) {
+	if (binary)
+	    offsets[i - 1] = dbpriv_dbio_input_pos();
+	if (!(binary ? read_binary_object() : read_object())) {
 	    errlog("READ_DB_FILE: Bad object #%d.\n", i - 1);
 	    return 0;
 	}
 	if (i == nobjs || log_report_progress())
 	    oklog("LOADING: Done reading %d objects ...\n", i);
     }
+    if (binary) {
+	int ok = read_object_index(offsets, nobjs, index_pos);
+
+	myfree(offsets, M_OBJECT_TABLE);
+	if (!ok) {
+	    errlog("READ_DB_FILE: Bad object index.\n");
+	    return 0;
+	}
+    }
 
     if (!validate_hierarchies()) {
 	errlog("READ_DB_FILE: Errors in object hierarchies.\n");
 	return 0;
     }
+    dbpriv_after_load();
     oklog("LOADING: Reading %d MOO verb programs...\n", nprogs);
     for (i = 1; i <= nprogs; i++) {
-	if (dbio_scanf("#%d:%d\n", &oid, &vnum) != 2) {
+	if (binary) {
+	    oid = dbio_read_num();
+	    vnum = dbio_read_num();
+	    if (dbpriv_dbio_input_failed()) {
+		errlog("READ_DB_FILE: Bad program header, i = %d.\n", i);
+		return 0;
+	    }
+	} else if (dbio_scanf("#%d:%d\n", &oid, &vnum) != 2) {
 	    errlog("READ_DB_FILE: Bad program header, i = %d.\n", i);
 	    return 0;
 	}
@@ -457,6 +585,10 @@ read_db_file(void)
 	    return 0;
 	}
 	program = dbio_read_program(dbio_input_version, fmt_verb_name, &h);
+	if (program && dbpriv_dbio_input_failed()) {
+	    free_program(program);	/* parsed from a truncated source */
+	    program = 0;
+	}
 	if (!program) {
 	    errlog("READ_DB_FILE: Unparsable program #%d:%d.\n", oid, vnum);
 	    return 0;
@@ -466,6 +598,9 @@ read_db_file(void)
 	    oklog("LOADING: Done reading %d verb programs...\n", i);
     }
 
+    /* The rest is in text, even in a binary DB. */
+    dbpriv_set_dbio_binary_input(0);
+
     oklog("LOADING: Reading forked and suspended tasks...\n");
     if (!read_task_queue()) {
 	errlog("READ_DB_FILE: Can't read task queue.\n");
@@ -492,6 +627,8 @@ write_db_file(const char *reason)
     int i;
     volatile int nprogs = 0;
     volatile int success = 1;
+    long index_field = 0;
+    long *offsets = 0;
 
     for (oid = 0; oid <= max_oid; oid++) {
 	if (valid(oid))
@@ -501,19 +638,42 @@ write_db_file(const char *reason)
     }
 
     user_list = db_all_users();
+    if (binary_dump > 0)
+	offsets = mymalloc((max_oid + 2) * sizeof(long), M_OBJECT_TABLE);
+    dbpriv_set_dbio_binary_output(0);
 
     TRY {
-	dbio_printf(header_format_string, current_db_version);
-	dbio_printf("%d\n%d\n%d\n%d\n",
-		    max_oid + 1, nprogs, 0, user_list.v.list[0].v.num);
+	if (binary_dump > 0) {
+	    dbio_printf(binary_header_format_string, current_db_version);
+	    dbpriv_set_dbio_binary_output(1);
+	    index_field = dbpriv_dbio_output_pos();
+	    dbpriv_dbio_write_fixed_offset(0);	/* filled in below */
+	    dbio_write_num(max_oid + 1);
+	    dbio_write_num(nprogs);
+	    dbio_write_num(user_list.v.list[0].v.num);
+	} else {
+	    dbio_printf(header_format_string, current_db_version);
+	    dbio_printf("%d\n%d\n%d\n%d\n",
+			max_oid + 1, nprogs, 0, user_list.v.list[0].v.num);
+	}
 	for (i = 1; i <= user_list.v.list[0].v.num; i++)
 	    dbio_write_objid(user_list.v.list[i].v.obj);
 	oklog("%s: Writing %d objects...\n", reason, max_oid + 1);
 	for (oid = 0; oid <= max_oid; oid++) {
-	    write_object(oid);
+	    if (offsets) {
+		offsets[oid] = dbpriv_dbio_output_pos();
+		write_binary_object(oid);
+	    } else
+		write_object(oid);
 	    if (oid == max_oid || log_report_progress())
 		oklog("%s: Done writing %d objects...\n", reason, oid + 1);
 	}
+	if (offsets) {
+	    dbpriv_dbio_patch_fixed_offset(index_field,
+					   dbpriv_dbio_output_pos());
+	    for (oid = 0; oid <= max_oid; oid++)
+		dbpriv_dbio_write_offset(offsets[oid]);
+	}
 	oklog("%s: Writing %d MOO verb programs...\n", reason, nprogs);
 	for (i = 0, oid = 0; oid <= max_oid; oid++)
 	    if (valid(oid)) {
@@ -521,7 +681,11 @@ write_db_file(const char *reason)
 
 		for (v = dbpriv_find_object(oid)->verbdefs; v; v = v->next) {
 		    if (v->program) {
-			dbio_printf("#%d:%d\n", oid, vcount);
+			if (offsets) {
+			    dbio_write_num(oid);
+			    dbio_write_num(vcount);
+			} else
+			    dbio_printf("#%d:%d\n", oid, vcount);
 			dbio_write_program(v->program);
 			if (++i == nprogs || log_report_progress())
 			    oklog("%s: Done writing %d verb programs...\n",
@@ -530,6 +694,7 @@ write_db_file(const char *reason)
 		    vcount++;
 		}
 	    }
+	dbpriv_set_dbio_binary_output(0);
 	oklog("%s: Writing forked and suspended tasks...\n", reason);
 	write_task_queue();
 	oklog("%s: Writing list of formerly active connections...\n", reason);
@@ -539,6 +704,8 @@ write_db_file(const char *reason)
 	success = 0;
     ENDTRY;
 
+    if (offsets)
+	myfree(offsets, M_OBJECT_TABLE);
     return success;
 }
 
@@ -648,6 +815,18 @@ db_usage_string(void)
 
 static FILE *input_db;
 
+int
+db_set_dump_format(const char *format)
+{
+    if (!strcmp(format, "text"))
+	binary_dump = 0;
+    else if (!strcmp(format, "binary"))
+	binary_dump = 1;
+    else
+	return 0;
+    return 1;
+}
+
 int
 db_initialize(int *pargc, char ***pargv)
 {
@@ -689,6 +868,7 @@ db_load(void)
 
     str_intern_close();
 
+    dbpriv_set_dbio_input(0);
     fclose(input_db);
     return 1;
 }
@@ -23,7 +23,13 @@
 #include <float.h>
 #include "my-stdarg.h"
 #include "my-stdio.h"
+#include "my-stat.h"
 #include "my-stdlib.h"
+#include "my-string.h"
+#include "my-unistd.h"
+#if HAVE_MMAP
+#include <sys/mman.h>
+#endif
 
 #include "db_io.h"
 #include "db_private.h"
@@ -40,20 +46,267 @@
 #include "version.h"
 
 
+/*********** Binary encoding ***********/
+
+/* In the binary format, numbers are zigzag-encoded varints (seven bits
+ * to a byte, least significant first, high bit set on all but the
+ * last), floats are their eight IEEE bytes, least significant first,
+ * and strings are their length followed by their bytes.  Everything
+ * else is built from those.
+ */
+
+static int
+little_endian(void)
+{
+    unsigned32 one = 1;
+
+    return *(unsigned char *) &one == 1;
+}
+
+
 /*********** Input ***********/
 
+/* The whole input file is mapped into memory (or, where that can't be
+ * done, read into it) and parsed where it lies: strings are interned
+ * straight from the file's bytes and the source of a verb program in a
+ * binary DB is parsed in place, so the only copies made are the ones
+ * kept.  Mapped pages that have been read are handed back to the system
+ * every INPUT_RELEASE_CHUNK bytes or so, so that loading a big database
+ * doesn't also hold the whole file in memory.
+ */
+
 static FILE *input;
+static const char *in_base;	/* the input's bytes, ... */
+static const char *in_ptr;	/* ... the next one to be read ... */
+static const char *in_end;	/* ... and the end of them */
+static long in_offset;		/* offset in the file of in_base */
+static int binary_input = 0;
+static int input_failed = 0;	/* input ran out early or made no sense */
+
+#if HAVE_MMAP
+static int in_mapped = 0;
+static const char *in_released;	/* pages before this were handed back */
+
+#define INPUT_RELEASE_CHUNK	(1024 * 1024)
+#endif
+
+static void
+map_input(void)
+{
+    long start = ftell(input);
+    char *b;
+    size_t size, n, got;
+
+    if (start < 0)
+	start = 0;
+#if HAVE_MMAP
+    {
+	struct stat st;
+	void *p;
+
+	if (fstat(fileno(input), &st) == 0 && S_ISREG(st.st_mode)
+	    && st.st_size > start
+	    && (p = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE,
+			 fileno(input), 0)) != MAP_FAILED) {
+#ifdef MADV_SEQUENTIAL
+	    madvise(p, st.st_size, MADV_SEQUENTIAL);
+#endif
+	    in_mapped = 1;
+	    in_base = in_released = p;
+	    in_ptr = in_base + start;
+	    in_end = in_base + st.st_size;
+	    in_offset = 0;
+	    return;
+	}
+    }
+#endif
+    size = 64 * 1024;
+    n = 0;
+    b = mymalloc(size, M_STREAM);
+    while ((got = fread(b + n, 1, size - n, input)) > 0)
+	if ((n += got) == size)
+	    b = myrealloc(b, size *= 2, M_STREAM);
+    in_base = in_ptr = b;
+    in_end = b + n;
+    in_offset = start;
+}
+
+static void
+unmap_input(void)
+{
+#if HAVE_MMAP
+    if (in_mapped) {
+	munmap((void *) in_base, in_end - in_base);
+	in_mapped = 0;
+    } else
+#endif
+	myfree((void *) in_base, M_STREAM);
+    in_base = in_ptr = in_end = 0;
+}
+
+/* Hand back the mapped pages that have been read, once there are enough of
+ * them to be worth the trouble.  Nothing may point into them any more.
+ */
+static void
+release_read_input(void)
+{
+#if HAVE_MMAP && defined(MADV_DONTNEED)
+    if (in_mapped && in_ptr - in_released >= INPUT_RELEASE_CHUNK) {
+	long page = sysconf(_SC_PAGESIZE);
+	const char *upto = in_base + (in_ptr - in_base) / page * page;
+
+	madvise((void *) in_released, upto - in_released, MADV_DONTNEED);
+	in_released = upto;
+    }
+#endif
+}
 
 void
 dbpriv_set_dbio_input(FILE * f)
 {
+    if (in_base)
+	unmap_input();
     input = f;
+    input_failed = 0;
+    if (f)
+	map_input();
+}
+
+void
+dbpriv_set_dbio_binary_input(int on)
+{
+    binary_input = on;
+}
+
+long
+dbpriv_dbio_input_pos(void)
+{
+    return in_offset + (in_ptr - in_base);
+}
+
+int
+dbpriv_dbio_input_failed(void)
+{
+    return input_failed;
+}
+
+int
+dbpriv_dbio_skip(const char *s)
+{
+    int len = strlen(s);
+
+    if (in_end - in_ptr < len || memcmp(in_ptr, s, len))
+	return 0;
+    in_ptr += len;
+    return 1;
+}
+
+int
+dbpriv_dbio_count_fits(int n)
+{
+    /* Every counted item takes at least a byte, in either encoding. */
+    if (n >= 0 && n <= in_end - in_ptr)
+	return 1;
+    if (!input_failed)
+	errlog("DBIO: Bad count %d at file pos. %ld\n",
+	       n, dbpriv_dbio_input_pos());
+    input_failed = 1;
+    return 0;
+}
+
+int
+dbpriv_dbio_read_count(void)
+{
+    int n = dbio_read_num();
+
+    return dbpriv_dbio_count_fits(n) ? n : 0;
+}
+
+static int
+read_byte(void)
+{
+    if (in_ptr >= in_end) {
+	if (!input_failed)
+	    errlog("DBIO: Unexpected EOF at file pos. %ld\n",
+		   dbpriv_dbio_input_pos());
+	input_failed = 1;
+	return 0;
+    }
+    return (unsigned char) *in_ptr++;
+}
+
+static unsigned long
+read_varint(void)
+{
+    unsigned long n = 0;
+    int shift = 0, c;
+
+    do {
+	c = read_byte();
+	if (shift < (int) sizeof(n) * 8)
+	    n |= (unsigned long) (c & 0x7F) << shift;
+	shift += 7;
+    } while (c & 0x80);
+
+    return n;
+}
+
+long
+dbpriv_dbio_read_offset(void)
+{
+    return read_varint();
+}
+
+long
+dbpriv_dbio_read_fixed_offset(void)
+{
+    unsigned long n = 0;
+    int i;
+
+    for (i = 0; i < 8; i++)
+	n |= (unsigned long) read_byte() << (8 * i);
+    return n;
 }
 
 void
 dbio_read_line(char *s, int n)
 {
-    fgets(s, n, input);
+    int i = 0;
+
+    while (i < n - 1 && in_ptr < in_end)
+	if ((s[i++] = *in_ptr++) == '\n')
+	    break;
+    s[i] = '\0';
+}
+
+static void
+skip_space(void)
+{
+    while (in_ptr < in_end && isspace((unsigned char) *in_ptr))
+	in_ptr++;
+}
+
+/* Read an optionally signed decimal number, as scanf("%d") would. */
+static int
+scan_num(long *np)
+{
+    const char *p;
+    unsigned long n = 0;
+    int neg = 0;
+
+    skip_space();
+    if (in_ptr == in_end)
+	return EOF;
+    p = in_ptr;
+    if (*p == '-' || *p == '+')
+	neg = *p++ == '-';
+    if (p == in_end || !isdigit((unsigned char) *p))
+	return 0;
+    while (p < in_end && isdigit((unsigned char) *p))
+	n = n * 10 + (*p++ - '0');
+    in_ptr = p;
+    *np = neg ? -(long) n : (long) n;
+    return 1;
 }
 
 int
@@ -70,45 +323,38 @@ dbio_scanf(const char *format,...)
      * symmetric such support for functions wrapping `printf'.  (*sigh*)
      * Fortunately, we only use a small fraction of the full functionality of
      * scanf in the server, so it's not unbearably unpleasant to have to
-     * reimplement it here.
+     * reimplement it here.  (Now that the input is read from memory rather
+     * than a FILE, it would be of no use anyway.)
      */
     /*  count = vfscanf(input, format, args);  */
 
     count = 0;
     for (ptr = format; *ptr; ptr++) {
-	int c, n, *ip;
-	unsigned *up;
-	char *cp;
-
-	if (isspace(*ptr)) {
-	    do
-		c = fgetc(input);
-	    while (isspace(c));
-	    ungetc(c, input);
-	} else if (*ptr != '%') {
-	    do
-		c = fgetc(input);
-	    while (isspace(c));
-
-	    if (c == EOF)
+	int n;
+	long l;
+
+	if (isspace(*ptr))
+	    skip_space();
+	else if (*ptr != '%') {
+	    skip_space();
+	    if (in_ptr == in_end)
 		return count ? count : EOF;
-	    else if (c != *ptr) {
-		ungetc(c, input);
+	    else if (*in_ptr != *ptr)
 		return count;
-	    }
+	    in_ptr++;
 	} else
 	    switch (*++ptr) {
 	    case 'd':
-		ip = va_arg(args, int *);
-		n = fscanf(input, "%d", ip);
+		if ((n = scan_num(&l)) == 1)
+		    *va_arg(args, int *) = l;
 		goto finish;
 	    case 'u':
-		up = va_arg(args, unsigned *);
-		n = fscanf(input, "%u", up);
+		if ((n = scan_num(&l)) == 1)
+		    *va_arg(args, unsigned *) = l;
 		goto finish;
 	    case 'c':
-		cp = va_arg(args, char *);
-		n = fscanf(input, "%c", cp);
+		if ((n = in_ptr < in_end ? 1 : EOF) == 1)
+		    *va_arg(args, char *) = *in_ptr++;
 	      finish:
 		if (n == 1)
 		    count++;
@@ -134,11 +380,16 @@ dbio_read_num(void)
     char *p;
     int i;
 
-    fgets(s, 20, input);
+    if (binary_input) {
+	unsigned32 n = read_varint();
+
+	return (int) (n >> 1) ^ -(int) (n & 1);
+    }
+    dbio_read_line(s, 20);
     i = strtol(s, &p, 10);
     if (isspace(*s) || *p != '\n')
 	errlog("DBIO_READ_NUM: Bad number: \"%s\" at file pos. %ld\n",
-	       s, ftell(input));
+	       s, dbpriv_dbio_input_pos());
     return i;
 }
 
@@ -149,11 +400,20 @@ dbio_read_float(void)
     char *p;
     double d;
 
-    fgets(s, 40, input);
+    if (binary_input) {
+	unsigned char b[sizeof(double)];
+	int i, le = little_endian();
+
+	for (i = 0; i < sizeof(double); i++)
+	    b[le ? i : sizeof(double) - 1 - i] = read_byte();
+	memcpy(&d, b, sizeof(double));
+	return d;
+    }
+    dbio_read_line(s, 40);
     d = strtod(s, &p);
     if (isspace(*s) || *p != '\n')
 	errlog("DBIO_READ_FLOAT: Bad number: \"%s\" at file pos. %ld\n",
-	       s, ftell(input));
+	       s, dbpriv_dbio_input_pos());
     return d;
 }
 
@@ -163,41 +423,65 @@ dbio_read_objid(void)
     return dbio_read_num();
 }
 
+/* Find the next string in the input, leaving it where it lies. */
+static const char *
+read_string_span(int *lenp)
+{
+    const char *s, *nl;
+    int len;
+
+    if (binary_input) {
+	unsigned long n = read_varint();
+
+	s = in_ptr;
+	if (n > (unsigned long) (in_end - in_ptr)) {
+	    if (!input_failed)
+		errlog("DBIO_READ_STRING: Bad length %lu at file pos. %ld\n",
+		       n, dbpriv_dbio_input_pos());
+	    input_failed = 1;
+	    n = 0;
+	}
+	len = n;
+	in_ptr += len;
+    } else {
+	s = in_ptr;
+	nl = memchr(s, '\n', in_end - s);
+	len = (nl ? nl : in_end) - s;
+	in_ptr = nl ? nl + 1 : in_end;
+    }
+    *lenp = len;
+    return s;
+}
+
 const char *
 dbio_read_string(void)
 {
-    static Stream *str = 0;
-    static char buffer[1024];
-    int len, used_stream = 0;
-
-    if (str == 0)
-	str = new_stream(1024);
-
-  try_again:
-    fgets(buffer, sizeof(buffer), input);
-    len = strlen(buffer);
-    if (len == sizeof(buffer) - 1 && buffer[len - 1] != '\n') {
-	stream_add_string(str, buffer);
-	used_stream = 1;
-	goto try_again;
+    static char *buffer = 0;
+    static int size = 0;
+    const char *s;
+    int len;
+
+    s = read_string_span(&len);
+    if (len >= size) {
+	if (buffer)
+	    myfree(buffer, M_STREAM);
+	size = len + 1 > 1024 ? len + 1 : 1024;
+	buffer = mymalloc(size, M_STREAM);
     }
-    if (buffer[len - 1] == '\n')
-	buffer[len - 1] = '\0';
-
-    if (used_stream) {
-	stream_add_string(str, buffer);
-	return reset_stream(str);
-    } else
-	return buffer;
+    memcpy(buffer, s, len);
+    buffer[len] = '\0';
+    return buffer;
 }
 
 const char *
 dbio_read_string_intern(void)
 {
     const char *s, *r;
+    int len;
 
-    s = dbio_read_string();
-    r = str_intern(s);
+    s = read_string_span(&len);
+    r = str_intern_span(s, len);
+    release_read_input();
 
     /* puts(r); */
 
@@ -235,14 +519,14 @@ dbio_read_var(void)
 	r = new_float(dbio_read_float());
 	break;
     case _TYPE_LIST:
-	l = dbio_read_num();
+	l = dbpriv_dbio_read_count();
 	r = new_list(l);
 	for (i = 0; i < l; i++)
 	    r.v.list[i + 1] = dbio_read_var();
 	break;
     default:
 	errlog("DBIO_READ_VAR: Unknown type (%d) at DB file pos. %ld\n",
-	       l, ftell(input));
+	       l, dbpriv_dbio_input_pos());
 	r = zero;
 	break;
     }
@@ -253,6 +537,8 @@ struct state {
     char prev_char;
     const char *(*fmtr) (void *);
     void *data;
+    const char *text;		/* read from here up to text_end, ... */
+    const char *text_end;	/* ... if text is non-null */
 };
 
 static const char *
@@ -284,10 +570,13 @@ my_getc(void *data)
     struct state *s = data;
     int c;
 
-    c = fgetc(input);
+    if (s->text)		/* the whole program, from a binary DB */
+	return s->text < s->text_end ? (unsigned char) *s->text++ : EOF;
+    c = in_ptr < in_end ? (unsigned char) *in_ptr++ : EOF;
     if (c == '.' && s->prev_char == '\n') {
 	/* end-of-verb marker in DB */
-	c = fgetc(input);	/* skip next newline */
+	if (in_ptr < in_end)
+	    in_ptr++;		/* skip next newline */
 	return EOF;
     }
     if (c == EOF)
@@ -303,11 +592,20 @@ Program *
 dbio_read_program(DB_Version version, const char *(*fmtr) (void *), void *data)
 {
     struct state s;
+    Program *program;
+    int len;
 
     s.prev_char = '\n';
     s.fmtr = fmtr;
     s.data = data;
-    return parse_program(version, parser_client, &s);
+    s.text = s.text_end = 0;
+    if (binary_input) {
+	s.text = read_string_span(&len);
+	s.text_end = s.text + len;
+    }
+    program = parse_program(version, parser_client, &s);
+    release_read_input();
+    return program;
 }
 
 
@@ -316,6 +614,9 @@ dbio_read_program(DB_Version version, const char *(*fmtr) (void *), void *data)
 Exception dbpriv_dbio_failed;
 
 static FILE *output;
+static int binary_output = 0;
+static long output_pos;		/* when binary_output, offset in file */
+static Stream *record = 0;	/* the record being written, if any */
 
 void
 dbpriv_set_dbio_output(FILE * f)
@@ -323,6 +624,98 @@ dbpriv_set_dbio_output(FILE * f)
     output = f;
 }
 
+void
+dbpriv_set_dbio_binary_output(int on)
+{
+    binary_output = on;
+    if (on)
+	output_pos = ftell(output);
+}
+
+long
+dbpriv_dbio_output_pos(void)
+{
+    return output_pos;
+}
+
+static void
+write_bytes(const char *b, int n)
+{
+    if (record)
+	stream_add_bytes(record, b, n);
+    else {
+	if (fwrite(b, 1, n, output) != n)
+	    RAISE(dbpriv_dbio_failed, 0);
+	output_pos += n;
+    }
+}
+
+static void
+write_varint(unsigned long n)
+{
+    char b[(sizeof(n) * 8 + 6) / 7];
+    int i = 0;
+
+    while (n >= 0x80) {
+	b[i++] = (n & 0x7F) | 0x80;
+	n >>= 7;
+    }
+    b[i++] = n;
+    write_bytes(b, i);
+}
+
+void
+dbpriv_dbio_write_offset(long offset)
+{
+    write_varint(offset);
+}
+
+void
+dbpriv_dbio_write_fixed_offset(long offset)
+{
+    char b[8];
+    int i;
+
+    for (i = 0; i < 8; i++)
+	b[i] = (unsigned long) offset >> (8 * i);
+    write_bytes(b, 8);
+}
+
+void
+dbpriv_dbio_patch_fixed_offset(long where, long offset)
+{
+    long here = output_pos;
+
+    if (fseek(output, where, SEEK_SET) != 0)
+	RAISE(dbpriv_dbio_failed, 0);
+    output_pos = where;
+    dbpriv_dbio_write_fixed_offset(offset);
+    if (fseek(output, here, SEEK_SET) != 0)
+	RAISE(dbpriv_dbio_failed, 0);
+    output_pos = here;
+}
+
+void
+dbpriv_begin_dbio_record(void)
+{
+    static Stream *s = 0;
+
+    if (!s)
+	s = new_stream(1000);
+    record = s;
+}
+
+void
+dbpriv_end_dbio_record(void)
+{
+    Stream *s = record;
+    int len = stream_length(s);
+
+    record = 0;
+    dbio_write_num(len);
+    write_bytes(reset_stream(s), len);
+}
+
 void
 dbio_printf(const char *format,...)
 {
@@ -337,7 +730,10 @@ dbio_printf(const char *format,...)
 void
 dbio_write_num(int n)
 {
-    dbio_printf("%d\n", n);
+    if (binary_output)
+	write_varint(((unsigned32) n << 1) ^ (unsigned32) - (n < 0));
+    else
+	dbio_printf("%d\n", n);
 }
 
 void
@@ -346,6 +742,17 @@ dbio_write_float(double d)
     static const char *fmt = 0;
     static char buffer[10];
 
+    if (binary_output) {
+	unsigned char b[sizeof(double)];
+	char out[sizeof(double)];
+	int i, le = little_endian();
+
+	memcpy(b, &d, sizeof(double));
+	for (i = 0; i < sizeof(double); i++)
+	    out[i] = b[le ? i : sizeof(double) - 1 - i];
+	write_bytes(out, sizeof(double));
+	return;
+    }
     if (!fmt) {
 	sprintf(buffer, "%%.%dg\n", DBL_DIG + 4);
 	fmt = buffer;
@@ -362,7 +769,13 @@ dbio_write_objid(Objid oid)
 void
 dbio_write_string(const char *s)
 {
-    dbio_printf("%s\n", s ? s : "");
+    if (binary_output) {
+	int len = s ? strlen(s) : 0;
+
+	write_varint(len);
+	write_bytes(s, len);
+    } else
+	dbio_printf("%s\n", s ? s : "");
 }
 
 void
@@ -386,7 +799,7 @@ dbio_write_var(Var v)
 	dbio_write_num(v.v.num);
 	break;
     case TYPE_FLOAT:
-	dbio_write_float(*v.v.fnum);
+	dbio_write_float(v.v.fnum);
 	break;
     case TYPE_LIST:
 	dbio_write_num(v.v.list[0].v.num);
@@ -402,9 +815,25 @@ receiver(void *data, const char *line)
     dbio_printf("%s\n", line);
 }
 
+static void
+binary_receiver(void *data, const char *line)
+{
+    stream_add_string(data, line);
+    stream_add_char(data, '\n');
+}
+
 void
 dbio_write_program(Program * program)
 {
+    if (binary_output) {	/* all of it as one string */
+	static Stream *s = 0;
+
+	if (!s)
+	    s = new_stream(1000);
+	unparse_program(program, binary_receiver, s, 1, 0, MAIN_VECTOR);
+	dbio_write_string(reset_stream(s));
+	return;
+    }
     unparse_program(program, receiver, 0, 1, 0, MAIN_VECTOR);
     dbio_printf(".\n");
 }
@@ -19,6 +19,9 @@
  * Routines for manipulating DB objects
  *****************************************************************************/
 
+#include "my-stdlib.h"
+#include "my-string.h"
+
 #include "config.h"
 #include "db.h"
 #include "db_private.h"
@@ -27,23 +30,12 @@
 #include "storage.h"
 #include "utils.h"
 
-static Object **objects;
-static int num_objects = 0;
-static int max_objects = 0;
+Object_Table dbpriv_objects;
 
 static Var all_users;
-
 
-/*********** Objects qua objects ***********/
 
-Object *
-dbpriv_find_object(Objid oid)
-{
-    if (oid < 0 || oid >= num_objects)
-	return 0;
-    else
-	return objects[oid];
-}
+/*********** Objects qua objects ***********/
 
 int
 valid(Objid oid)
@@ -54,45 +46,63 @@ valid(Objid oid)
 Objid
 db_last_used_objid(void)
 {
-    return num_objects - 1;
+    return dbpriv_objects.num_objects - 1;
 }
 
 void
 db_reset_last_used_objid(void)
 {
-    while (!objects[num_objects - 1])
-	num_objects--;
+    while (!dbpriv_objects.objects[dbpriv_objects.num_objects - 1])
+	dbpriv_objects.num_objects--;
 }
 
+#define GROW(field)							\
+    dbpriv_objects.field =						\
+	(dbpriv_objects.field						\
+	 ? myrealloc(dbpriv_objects.field,				\
+		     max * sizeof(*dbpriv_objects.field), M_OBJECT_TABLE)	\
+	 : mymalloc(max * sizeof(*dbpriv_objects.field), M_OBJECT_TABLE))
+
 static void
 ensure_new_object(void)
 {
-    if (max_objects == 0) {
-	max_objects = 100;
-	objects = mymalloc(max_objects * sizeof(Object *), M_OBJECT_TABLE);
-    }
-    if (num_objects >= max_objects) {
-	int i;
-	Object **new;
-
-	new = mymalloc(max_objects * 2 * sizeof(Object *), M_OBJECT_TABLE);
-	for (i = 0; i < max_objects; i++)
-	    new[i] = objects[i];
-	myfree(objects, M_OBJECT_TABLE);
-	objects = new;
-	max_objects *= 2;
-    }
+    int max = dbpriv_objects.max_objects;
+
+    if (dbpriv_objects.num_objects < max)
+	return;
+    max = max ? max * 2 : 100;
+    GROW(objects);
+    GROW(owner);
+    GROW(location);
+    GROW(parent);
+    GROW(verb_ancestor);
+    GROW(flags);
+    GROW(pre);
+    GROW(post);
+    dbpriv_objects.max_objects = max;
 }
 
+#undef GROW
+
 Object *
 dbpriv_new_object(void)
 {
     Object *o;
+    Objid oid;
 
     ensure_new_object();
-    o = objects[num_objects] = mymalloc(sizeof(Object), M_OBJECT);
-    o->id = num_objects;
-    num_objects++;
+    oid = dbpriv_objects.num_objects++;
+    o = dbpriv_objects.objects[oid] = mymalloc(sizeof(Object), M_OBJECT);
+    o->id = oid;
+    o->propsegs = 0;
+    o->num_propsegs = 0;
+    o->holders = 0;
+    o->num_holders = o->max_holders = 0;
+    o->prop_index = 0;
+    o->contents_list.type = TYPE_NONE;
+    o->name_index = 0;
+    o->children_list.type = TYPE_NONE;
+    obj_verb_ancestor(oid) = NOTHING;
 
     return o;
 }
@@ -101,7 +111,191 @@ void
 dbpriv_new_recycled_object(void)
 {
     ensure_new_object();
-    objects[num_objects++] = 0;
+    dbpriv_objects.objects[dbpriv_objects.num_objects++] = 0;
+}
+
+/*********** Ancestry labels ***********/
+
+/* Every object has two labels, obj_pre() and obj_post(), such that its
+ * descendants' labels all lie strictly between them and those of any
+ * object that is neither its ancestor nor its descendant lie outside;
+ * so db_object_isa() is just two comparisons.  Children are labelled in
+ * the order of their parent's children list.  relabel_all() spaces the
+ * labels label_stride apart, leaving room at the end of each object's
+ * interval for new children (LABEL_GAP strides for each child it has and
+ * one more), and as much room again after the last top-level object, so
+ * that a new or reparented object can usually be labelled in place as
+ * the last of its parent's children.  When one can't, the labels are
+ * marked stale, and db_object_isa() walks up the hierarchy instead until
+ * it has walked about as far as a relabel_all() would cost.
+ */
+
+#define LABEL_MAX	((unsigned32) 0xFFFFFFFF)
+#define LABEL_GAP	8
+
+/* Labels used by a subtree of N objects, in units of the stride: a start
+ * and end for each, plus the room left for new children.
+ */
+#define LABEL_UNITS(n)	((2 + 2 * LABEL_GAP) * (unsigned32) (n) - LABEL_GAP)
+
+static int labels_stale = 1;
+static unsigned32 label_stride;
+static unsigned32 roots_end = 0;	/* obj_post() of the last top-level
+					 * object labelled */
+static unsigned stale_steps = 0;	/* walked by db_object_isa() since
+					 * the labels went stale */
+
+/* The object after OID in a depth-first walk of TOP's subtree, or NOTHING.
+ */
+static Objid
+next_in_subtree(Objid top, Objid oid)
+{
+    Object *o = dbpriv_find_object(oid);
+
+    if (o->child != NOTHING)
+	return o->child;
+    for (; oid != top; oid = obj_parent(oid)) {
+	o = dbpriv_find_object(oid);
+	if (o->sibling != NOTHING)
+	    return o->sibling;
+    }
+    return NOTHING;
+}
+
+static int
+subtree_size(Objid top)
+{
+    Objid oid;
+    int n = 0;
+
+    for (oid = top; oid != NOTHING; oid = next_in_subtree(top, oid))
+	n++;
+
+    return n;
+}
+
+/* Labels TOP's subtree from LABEL on, STRIDE apart; returns the label
+ * after the last one used.
+ */
+static unsigned32
+label_subtree(Objid top, unsigned32 label, unsigned32 stride)
+{
+    Objid oid = top;
+    Object *o;
+
+    for (;;) {
+	obj_pre(oid) = label;
+	label += stride;
+	o = dbpriv_find_object(oid);
+	if (o->child != NOTHING) {
+	    oid = o->child;
+	    continue;
+	}
+	for (;;) {		/* close OID and each ancestor it ends */
+	    label += LABEL_GAP * (o->num_children + 1) * stride;
+	    obj_post(oid) = label;
+	    label += stride;
+	    if (oid == top)
+		return label;
+	    if (o->sibling != NOTHING) {
+		oid = o->sibling;
+		break;
+	    }
+	    oid = obj_parent(oid);
+	    o = dbpriv_find_object(oid);
+	}
+    }
+}
+
+static void
+relabel_all(void)
+{
+    Objid oid;
+    unsigned32 n = 0, label;
+
+    stale_steps = 0;
+    for (oid = 0; oid < dbpriv_objects.num_objects; oid++)
+	if (valid(oid))
+	    n++;
+    if (n > LABEL_MAX / 2 / (2 + 2 * LABEL_GAP))
+	return;			/* can't be done; just walk */
+
+    label_stride = LABEL_MAX / 2 / (LABEL_UNITS(n) + 1);
+    label = label_stride;
+    roots_end = 0;
+    for (oid = 0; oid < dbpriv_objects.num_objects; oid++)
+	if (valid(oid) && obj_parent(oid) == NOTHING) {
+	    label = label_subtree(oid, label, label_stride);
+	    roots_end = obj_post(oid);
+	}
+    labels_stale = 0;
+}
+
+/* OID has just become the last child of its parent, or a top-level
+ * object; label it and its descendants if there's room.
+ */
+static void
+label_attached(Objid oid)
+{
+    Objid parent = obj_parent(oid);
+    unsigned32 lo, hi, stride;
+
+    if (labels_stale)
+	return;
+    if (parent == NOTHING) {
+	lo = roots_end;
+	hi = LABEL_MAX;
+    } else {
+	Objid prev = dbpriv_find_object(oid)->prev_sibling;
+
+	lo = prev != NOTHING ? obj_post(prev) : obj_pre(parent);
+	hi = obj_post(parent);
+    }
+    stride = (hi - lo) / (LABEL_UNITS(subtree_size(oid)) + 1);
+    if (stride > label_stride)
+	stride = label_stride;
+    if (stride == 0) {
+	labels_stale = 1;
+	return;
+    }
+    label_subtree(oid, lo + stride, stride);
+    if (parent == NOTHING)
+	roots_end = obj_post(oid);
+}
+
+int
+db_object_isa(Objid oid, Objid ancestor)
+{
+    if (!labels_stale)
+	return (obj_pre(ancestor) <= obj_pre(oid)
+		&& obj_post(oid) <= obj_post(ancestor));
+
+    for (; oid != NOTHING && oid != ancestor; oid = obj_parent(oid))
+	stale_steps++;
+    if (stale_steps > (unsigned) dbpriv_objects.num_objects)
+	relabel_all();
+
+    return oid != NOTHING;
+}
+
+int
+db_count_descendants(Objid oid)
+{
+    return subtree_size(oid) - 1;
+}
+
+int
+db_for_all_descendants(Objid oid, int (*func) (void *, Objid), void *data)
+{
+    Objid d;
+
+    for (d = next_in_subtree(oid, oid);
+	 d != NOTHING;
+	 d = next_in_subtree(oid, d))
+	if (func(data, d))
+	    return 1;
+
+    return 0;
 }
 
 Objid
@@ -114,9 +308,13 @@ db_create_object(void)
     oid = o->id;
 
     o->name = str_dup("");
-    o->flags = 0;
-    o->parent = o->child = o->sibling = NOTHING;
-    o->location = o->contents = o->next = NOTHING;
+    obj_flags(oid) = 0;
+    obj_parent(oid) = NOTHING;
+    o->child = o->last_child = o->sibling = o->prev_sibling = NOTHING;
+    o->num_children = 0;
+    obj_location(oid) = NOTHING;
+    o->contents = o->last_content = o->next = o->prev = NOTHING;
+    o->num_contents = 0;
 
     o->propval = 0;
 
@@ -126,9 +324,184 @@ db_create_object(void)
 
     o->verbdefs = 0;
 
+    label_attached(oid);
+
     return oid;
 }
 
+/* The names by which match_object() finds the contents of an object: the
+ * name of each, and the strings in its `aliases', sorted by
+ * mystrcasecmp() so that those starting with any given prefix are
+ * together.  An index is built when first asked for and then kept up to
+ * date as objects come and go, or change their own name or `aliases'.  A
+ * change that may alter the `aliases' of many objects at once (one that
+ * descendants inherit, or adding, removing or renaming the property
+ * itself) makes every index stale instead, by bumping name_generation; a
+ * stale index is rebuilt when next wanted.
+ */
+
+struct Name_Index {
+    unsigned generation;
+    int count, max;
+    db_name_entry *names;
+};
+
+static unsigned name_generation = 1;
+
+static void
+free_name_index(Object * o)
+{
+    Name_Index *ni = o->name_index;
+    int i;
+
+    if (ni) {
+	for (i = 0; i < ni->count; i++)
+	    free_str(ni->names[i].name);
+	if (ni->names)
+	    myfree(ni->names, M_NAME_INDEX);
+	myfree(ni, M_NAME_INDEX);
+	o->name_index = 0;
+    }
+}
+
+void
+dbpriv_names_changed(void)
+{
+    if (++name_generation == 0) {	/* wrapped; forget everything */
+	Objid oid;
+
+	for (oid = 0; oid < dbpriv_objects.num_objects; oid++)
+	    if (dbpriv_objects.objects[oid])
+		free_name_index(dbpriv_objects.objects[oid]);
+	name_generation = 1;
+    }
+}
+
+static void
+add_name(Name_Index * ni, const char *name, Objid oid, int sorted)
+{
+    int lo = ni->count, hi = ni->count;
+
+    if (ni->count == ni->max) {
+	ni->max = ni->max ? 2 * ni->max : 8;
+	ni->names = myrealloc(ni->names, ni->max * sizeof(db_name_entry),
+			      M_NAME_INDEX);
+    }
+    if (sorted) {		/* find the end of NAME's run */
+	lo = 0;
+	while (lo < hi) {
+	    int mid = (lo + hi) / 2;
+
+	    if (mystrcasecmp(ni->names[mid].name, name) <= 0)
+		lo = mid + 1;
+	    else
+		hi = mid;
+	}
+	memmove(ni->names + lo + 1, ni->names + lo,
+		(ni->count - lo) * sizeof(db_name_entry));
+    }
+    ni->names[lo].name = str_ref(name);
+    ni->names[lo].oid = oid;
+    ni->count++;
+}
+
+static void
+add_object_names(Name_Index * ni, Objid oid, int sorted)
+{
+    Var value;
+    int i;
+
+    add_name(ni, db_object_name(oid), oid, sorted);
+    if (db_find_property(oid, "aliases", &value).ptr
+	&& value.type == TYPE_LIST)
+	for (i = 1; i <= value.v.list[0].v.num; i++)
+	    if (value.v.list[i].type == TYPE_STR)
+		add_name(ni, value.v.list[i].v.str, oid, sorted);
+}
+
+static void
+remove_object_names(Name_Index * ni, Objid oid)
+{
+    int i, j;
+
+    for (i = j = 0; i < ni->count; i++)
+	if (ni->names[i].oid == oid)
+	    free_str(ni->names[i].name);
+	else
+	    ni->names[j++] = ni->names[i];
+    ni->count = j;
+}
+
+static int
+compare_names(const void *a, const void *b)
+{
+    return mystrcasecmp(((const db_name_entry *) a)->name,
+			((const db_name_entry *) b)->name);
+}
+
+const db_name_entry *
+db_contents_names(Objid oid, int *count)
+{
+    Object *o = dbpriv_find_object(oid);
+    Name_Index *ni = o->name_index;
+    Objid c;
+
+    if (ni && ni->generation != name_generation) {
+	free_name_index(o);
+	ni = 0;
+    }
+    if (!ni) {
+	ni = o->name_index = mymalloc(sizeof(Name_Index), M_NAME_INDEX);
+	ni->generation = name_generation;
+	ni->count = ni->max = 0;
+	ni->names = 0;
+	for (c = o->contents; c != NOTHING; c = dbpriv_find_object(c)->next)
+	    add_object_names(ni, c, 0);
+	if (ni->count > 1)
+	    qsort(ni->names, ni->count, sizeof(db_name_entry), compare_names);
+    }
+    *count = ni->count;
+    return ni->names;
+}
+
+static void
+update_name_index(Objid where, Objid oid, int arriving)
+{
+    Object *o = dbpriv_find_object(where);
+    Name_Index *ni = o->name_index;
+
+    if (!ni)
+	return;
+    if (ni->generation != name_generation)
+	free_name_index(o);
+    else if (arriving)
+	add_object_names(ni, oid, 1);
+    else
+	remove_object_names(ni, oid);
+}
+
+void
+dbpriv_object_names_changed(Objid oid, int inherited)
+{
+    Objid where = obj_location(oid);
+
+    if (inherited && dbpriv_find_object(oid)->child != NOTHING)
+	dbpriv_names_changed();
+    else if (valid(where)) {
+	update_name_index(where, oid, 0);
+	update_name_index(where, oid, 1);
+    }
+}
+
+static inline void
+forget_list(Var * list)
+{
+    if (list->type != TYPE_NONE) {
+	free_var(*list);
+	list->type = TYPE_NONE;
+    }
+}
+
 void
 db_destroy_object(Objid oid)
 {
@@ -136,13 +509,13 @@ db_destroy_object(Objid oid)
     Verbdef *v, *w;
     int i;
 
-    db_priv_affected_callable_verb_lookup();
+    db_priv_affected_callable_verb_lookup(oid);
 
     if (!o)
 	panic("DB_DESTROY_OBJECT: Invalid object!");
 
-    if (o->location != NOTHING || o->contents != NOTHING
-	|| o->parent != NOTHING || o->child != NOTHING)
+    if (obj_location(oid) != NOTHING || o->contents != NOTHING
+	|| obj_parent(oid) != NOTHING || o->child != NOTHING)
 	panic("DB_DESTROY_OBJECT: Not a barren orphan!");
 
     if (is_user(oid)) {
@@ -165,26 +538,84 @@ db_destroy_object(Objid oid)
 	myfree(o->propval, M_PVAL);
     if (o->propdefs.l)
 	myfree(o->propdefs.l, M_PROPDEF);
+    dbpriv_free_prop_index(o);
+    dbpriv_props_changed();	/* lookups on OID are cached */
+    forget_list(&o->contents_list);
+    forget_list(&o->children_list);
+    free_name_index(o);
 
     for (v = o->verbdefs; v; v = w) {
 	if (v->program)
 	    free_program(v->program);
 	free_str(v->name);
+	dbpriv_free_verb_matcher(v);
 	w = v->next;
 	myfree(v, M_VERBDEF);
     }
 
-    myfree(objects[oid], M_OBJECT);
-    objects[oid] = 0;
+    myfree(o, M_OBJECT);
+    dbpriv_objects.objects[oid] = 0;
+}
+
+/* The contents and children lists (see db_private.h): WHERE's list runs
+ * from its FIRST to its LAST member, through their NEXT and PREV fields,
+ * and has COUNT members; LIST, the same as a MOO list, is dropped
+ * whenever the list changes.
+ */
+
+#define LL_REMOVE(where, first, last, count, list, what, next, prev) { \
+    Object **objects = dbpriv_objects.objects; \
+    Object *w = objects[what]; \
+    forget_list(&objects[where]->list); \
+    if (w->prev == NOTHING) \
+	objects[where]->first = w->next; \
+    else \
+	objects[w->prev]->next = w->next; \
+    if (w->next == NOTHING) \
+	objects[where]->last = w->prev; \
+    else \
+	objects[w->next]->prev = w->prev; \
+    objects[where]->count--; \
+    w->next = w->prev = NOTHING; \
+}
+
+#define LL_APPEND(where, first, last, count, list, what, next, prev) { \
+    Object **objects = dbpriv_objects.objects; \
+    Object *w = objects[what]; \
+    forget_list(&objects[where]->list); \
+    w->next = NOTHING; \
+    w->prev = objects[where]->last; \
+    if (w->prev == NOTHING) \
+	objects[where]->first = what; \
+    else \
+	objects[w->prev]->next = what; \
+    objects[where]->last = what; \
+    objects[where]->count++; \
+}
+
+/* WHAT, a member of WHERE's list, has just been renumbered. */
+#define LL_RENAME(where, first, last, list, what, next, prev) { \
+    Object **objects = dbpriv_objects.objects; \
+    Object *w = objects[what]; \
+    forget_list(&objects[where]->list); \
+    if (w->prev == NOTHING) \
+	objects[where]->first = what; \
+    else \
+	objects[w->prev]->next = what; \
+    if (w->next == NOTHING) \
+	objects[where]->last = what; \
+    else \
+	objects[w->next]->prev = what; \
 }
 
 Objid
 db_renumber_object(Objid old)
 {
+    Object **objects = dbpriv_objects.objects;
     Objid new;
     Object *o;
 
-    db_priv_affected_callable_verb_lookup();
+    db_priv_affected_callable_verb_lookup(NOTHING);
 
     for (new = 0; new < old; new++) {
 	if (objects[new] == 0) {
@@ -192,41 +623,55 @@ db_renumber_object(Objid old)
 	    o = objects[new] = objects[old];
 	    objects[old] = 0;
 	    objects[new]->id = new;
+	    obj_owner(new) = obj_owner(old);
+	    obj_location(new) = obj_location(old);
+	    obj_parent(new) = obj_parent(old);
+	    obj_flags(new) = obj_flags(old);
+	    obj_pre(new) = obj_pre(old);
+	    obj_post(new) = obj_post(old);
 
 	    /* Fix up the parent/children hierarchy */
 	    {
-		Objid oid, *oidp;
-
-		if (o->parent != NOTHING) {
-		    oidp = &objects[o->parent]->child;
-		    while (*oidp != old && *oidp != NOTHING)
-			oidp = &objects[*oidp]->sibling;
-		    if (*oidp == NOTHING)
-			panic("Object not in parent's children list");
-		    *oidp = new;
-		}
+		Objid oid;
+
+		if (obj_parent(new) != NOTHING)
+		    LL_RENAME(obj_parent(new), child, last_child,
+			      children_list, new, sibling, prev_sibling);
 		for (oid = o->child;
 		     oid != NOTHING;
 		     oid = objects[oid]->sibling)
-		    objects[oid]->parent = new;
+		    obj_parent(oid) = new;
 	    }
 
 	    /* Fix up the location/contents hierarchy */
 	    {
-		Objid oid, *oidp;
-
-		if (o->location != NOTHING) {
-		    oidp = &objects[o->location]->contents;
-		    while (*oidp != old && *oidp != NOTHING)
-			oidp = &objects[*oidp]->next;
-		    if (*oidp == NOTHING)
-			panic("Object not in location's contents list");
-		    *oidp = new;
+		Objid oid;
+
+		if (obj_location(new) != NOTHING) {
+		    LL_RENAME(obj_location(new), contents, last_content,
+			      contents_list, new, next, prev);
+		    free_name_index(objects[obj_location(new)]);
 		}
 		for (oid = o->contents;
 		     oid != NOTHING;
 		     oid = objects[oid]->next)
-		    objects[oid]->location = new;
+		    obj_location(oid) = new;
+	    }
+
+	    /* Fix up the first-ancestor-with-verbs of it and its kids */
+	    dbpriv_fix_verb_ancestors(new);
+
+	    /* Property lookups and indexes name it as a definer, and the
+	     * objects defining the properties it holds values for list it
+	     * among their holders
+	     */
+	    dbpriv_props_changed();
+	    {
+		int i;
+
+		for (i = 0; i < o->num_propsegs; i++)
+		    objects[o->propsegs[i].definer]
+			->holders[o->propsegs[i].holder] = new;
 	    }
 
 	    /* Fix up the list of users, if necessary */
@@ -243,19 +688,20 @@ db_renumber_object(Objid old)
 	    {
 		Objid oid;
 
-		for (oid = 0; oid < num_objects; oid++) {
+		for (oid = 0; oid < dbpriv_objects.num_objects; oid++) {
 		    Object *o = objects[oid];
 		    Verbdef *v;
+		    Propseg *s;
 		    Pval *p;
 		    int i, count;
 
 		    if (!o)
 			continue;
 
-		    if (o->owner == new)
-			o->owner = NOTHING;
-		    else if (o->owner == old)
-			o->owner = new;
+		    if (obj_owner(oid) == new)
+			obj_owner(oid) = NOTHING;
+		    else if (obj_owner(oid) == old)
+			obj_owner(oid) = new;
 
 		    for (v = o->verbdefs; v; v = v->next)
 			if (v->owner == new)
@@ -263,13 +709,21 @@ db_renumber_object(Objid old)
 			else if (v->owner == old)
 			    v->owner = new;
 
-		    count = dbpriv_count_properties(oid);
+		    count = o->propdefs.cur_length;
 		    p = o->propval;
-		    for (i = 0; i < count; i++)
-			if (p[i].owner == new)
-			    p[i].owner = NOTHING;
-			else if (p[i].owner == old)
-			    p[i].owner = new;
+		    for (s = o->propsegs;; s++) {
+			for (i = 0; i < count; i++)
+			    if (p[i].owner == new)
+				p[i].owner = NOTHING;
+			    else if (p[i].owner == old)
+				p[i].owner = new;
+			if (s == o->propsegs + o->num_propsegs)
+			    break;
+			if (s->definer == old)
+			    s->definer = new;
+			count = s->length;
+			p = s->vals;
+		    }
 		}
 	    }
 
@@ -284,11 +738,12 @@ db_renumber_object(Objid old)
 int
 db_object_bytes(Objid oid)
 {
-    Object *o = objects[oid];
-    int i, len, count;
+    Object *o = dbpriv_find_object(oid);
+    int i, j, count;
     Verbdef *v;
 
     count = sizeof(Object) + sizeof(Object *);
+    count += 4 * sizeof(Objid) + sizeof(int);	/* the hot fields */
     count += memo_strlen(o->name) + 1;
 
     for (v = o->verbdefs; v; v = v->next) {
@@ -302,10 +757,18 @@ db_object_bytes(Objid oid)
     for (i = 0; i < o->propdefs.cur_length; i++)
 	count += memo_strlen(o->propdefs.l[i].name) + 1;
 
-    len = dbpriv_count_properties(oid);
-    count += (sizeof(Pval) - sizeof(Var)) * len;
-    for (i = 0; i < len; i++)
+    count += (sizeof(Pval) - sizeof(Var)) * o->propdefs.cur_length;
+    for (i = 0; i < o->propdefs.cur_length; i++)
 	count += value_bytes(o->propval[i].var);
+    count += sizeof(Objid) * o->max_holders;
+    count += sizeof(Propseg) * o->num_propsegs;
+    for (i = 0; i < o->num_propsegs; i++) {
+	Propseg *s = o->propsegs + i;
+
+	count += (sizeof(Pval) - sizeof(Var)) * s->length;
+	for (j = 0; j < s->length; j++)
+	    count += value_bytes(s->vals[j].var);
+    }
 
     return count;
 }
@@ -316,47 +779,64 @@ db_object_bytes(Objid oid)
 Objid
 db_object_owner(Objid oid)
 {
-    return objects[oid]->owner;
+    return obj_owner(oid);
 }
 
 void
 db_set_object_owner(Objid oid, Objid owner)
 {
-    objects[oid]->owner = owner;
+    if (owner != obj_owner(oid))
+	dbpriv_fix_properties_for_chown(oid);
+    obj_owner(oid) = owner;
 }
 
 const char *
 db_object_name(Objid oid)
 {
-    return objects[oid]->name;
+    return dbpriv_find_object(oid)->name;
 }
 
 void
 db_set_object_name(Objid oid, const char *name)
 {
-    Object *o = objects[oid];
+    Object *o = dbpriv_find_object(oid);
+    int same = o->name && !strcmp(o->name, name);
 
     if (o->name)
 	free_str(o->name);
     o->name = name;
+    if (!same)
+	dbpriv_object_names_changed(oid, 0);
 }
 
 Objid
 db_object_parent(Objid oid)
 {
-    return objects[oid]->parent;
+    return obj_parent(oid);
 }
 
 int
 db_count_children(Objid oid)
 {
+    return dbpriv_find_object(oid)->num_children;
+}
+
+Var
+db_object_children(Objid oid)
+{
+    Object *o = dbpriv_find_object(oid);
     Objid c;
     int i = 0;
 
-    for (c = objects[oid]->child; c != NOTHING; c = objects[c]->sibling)
-	i++;
-
-    return i;
+    if (o->children_list.type == TYPE_NONE) {
+	o->children_list = new_list(o->num_children);
+	for (c = o->child; c != NOTHING; c = dbpriv_find_object(c)->sibling) {
+	    i++;
+	    o->children_list.v.list[i].type = TYPE_OBJ;
+	    o->children_list.v.list[i].v.obj = c;
+	}
+    }
+    return var_ref(o->children_list);
 }
 
 int
@@ -364,52 +844,85 @@ db_for_all_children(Objid oid, int (*func) (void *, Objid), void *data)
 {
     Objid c;
 
-    for (c = objects[oid]->child; c != NOTHING; c = objects[c]->sibling)
+    for (c = dbpriv_find_object(oid)->child;
+	 c != NOTHING;
+	 c = dbpriv_find_object(c)->sibling)
 	if (func(data, c))
 	    return 1;
 
     return 0;
 }
 
-#define LL_REMOVE(where, listname, what, nextname) { \
-    Objid lid; \
-    if (objects[where]->listname == what) \
-	objects[where]->listname = objects[what]->nextname; \
-    else { \
-	for (lid = objects[where]->listname; lid != NOTHING; \
-	      lid = objects[lid]->nextname) { \
-	    if (objects[lid]->nextname == what) { \
-		objects[lid]->nextname = objects[what]->nextname; \
-		break; \
-	    } \
-	} \
-    } \
-    objects[what]->nextname = NOTHING; \
-}
-
-#define LL_APPEND(where, listname, what, nextname) { \
-    Objid lid; \
-    if (objects[where]->listname == NOTHING) { \
-	objects[where]->listname = what; \
-    } else { \
-	for (lid = objects[where]->listname; \
-	     objects[lid]->nextname != NOTHING; \
-	     lid = objects[lid]->nextname) \
-	    ; \
-	objects[lid]->nextname = what; \
-    } \
-    objects[what]->nextname = NOTHING; \
+void
+dbpriv_after_load(void)
+{
+    Objid oid, c, prev;
+    Object *o;
+
+    for (oid = 0; oid < dbpriv_objects.num_objects; oid++) {
+	if (!(o = dbpriv_find_object(oid)))
+	    continue;
+
+	if (obj_parent(oid) == NOTHING)
+	    o->prev_sibling = NOTHING;
+	o->num_children = 0;
+	for (prev = NOTHING, c = o->child;
+	     c != NOTHING;
+	     prev = c, c = dbpriv_find_object(c)->sibling) {
+	    dbpriv_find_object(c)->prev_sibling = prev;
+	    o->num_children++;
+	}
+	o->last_child = prev;
+
+	if (obj_location(oid) == NOTHING)
+	    o->prev = NOTHING;
+	o->num_contents = 0;
+	for (prev = NOTHING, c = o->contents;
+	     c != NOTHING;
+	     prev = c, c = dbpriv_find_object(c)->next) {
+	    dbpriv_find_object(c)->prev = prev;
+	    o->num_contents++;
+	}
+	o->last_content = prev;
+    }
+
+    for (oid = 0; oid < dbpriv_objects.num_objects; oid++)
+	if (valid(oid) && obj_parent(oid) == NOTHING)
+	    dbpriv_fix_verb_ancestors(oid);
+
+    relabel_all();
+    dbpriv_split_propvals();
+}
+
+void
+dbpriv_fix_verb_ancestors(Objid oid)
+{
+    Object *o = dbpriv_find_object(oid);
+    Objid c, parent = obj_parent(oid);
+
+    if (o->verbdefs)
+	obj_verb_ancestor(oid) = oid;
+    else if (parent != NOTHING)
+	obj_verb_ancestor(oid) = obj_verb_ancestor(parent);
+    else
+	obj_verb_ancestor(oid) = NOTHING;
+
+    for (c = o->child; c != NOTHING; c = dbpriv_find_object(c)->sibling)
+	dbpriv_fix_verb_ancestors(c);
 }
 
 int
 db_change_parent(Objid oid, Objid parent)
 {
     Objid old_parent;
+    int had_aliases;
 
     if (!dbpriv_check_properties_for_chparent(oid, parent))
 	return 0;
+    had_aliases = db_find_property(oid, "aliases", 0).ptr != 0;
 
-    if (objects[oid]->child == NOTHING && objects[oid]->verbdefs == NULL) {
+    if (dbpriv_find_object(oid)->child == NOTHING
+	&& dbpriv_find_object(oid)->verbdefs == NULL) {
 	/* Since this object has no children and no verbs, we know that it
 	   can't have had any part in affecting verb lookup, since we use first
 	   parent with verbs as a key in the verb lookup cache. */
@@ -419,19 +932,25 @@ db_change_parent(Objid oid, Objid parent)
 	/* In any case, don't clear the cache. */
 	;
     } else {
-	db_priv_affected_callable_verb_lookup();
+	db_priv_affected_callable_verb_lookup(oid);
     }
 
-    old_parent = objects[oid]->parent;
+    old_parent = obj_parent(oid);
 
     if (old_parent != NOTHING)
-	LL_REMOVE(old_parent, child, oid, sibling);
+	LL_REMOVE(old_parent, child, last_child, num_children,
+		  children_list, oid, sibling, prev_sibling);
 
     if (parent != NOTHING)
-	LL_APPEND(parent, child, oid, sibling);
+	LL_APPEND(parent, child, last_child, num_children,
+		  children_list, oid, sibling, prev_sibling);
 
-    objects[oid]->parent = parent;
+    obj_parent(oid) = parent;
+    label_attached(oid);
+    dbpriv_fix_verb_ancestors(oid);
     dbpriv_fix_properties_after_chparent(oid, old_parent);
+    if (had_aliases || db_find_property(oid, "aliases", 0).ptr)
+	dbpriv_object_names_changed(oid, 1);
 
     return 1;
 }
@@ -439,19 +958,31 @@ db_change_parent(Objid oid, Objid parent)
 Objid
 db_object_location(Objid oid)
 {
-    return objects[oid]->location;
+    return obj_location(oid);
 }
 
 int
 db_count_contents(Objid oid)
 {
+    return dbpriv_find_object(oid)->num_contents;
+}
+
+Var
+db_object_contents(Objid oid)
+{
+    Object *o = dbpriv_find_object(oid);
     Objid c;
     int i = 0;
 
-    for (c = objects[oid]->contents; c != NOTHING; c = objects[c]->next)
-	i++;
-
-    return i;
+    if (o->contents_list.type == TYPE_NONE) {
+	o->contents_list = new_list(o->num_contents);
+	for (c = o->contents; c != NOTHING; c = dbpriv_find_object(c)->next) {
+	    i++;
+	    o->contents_list.v.list[i].type = TYPE_OBJ;
+	    o->contents_list.v.list[i].v.obj = c;
+	}
+    }
+    return var_ref(o->contents_list);
 }
 
 int
@@ -459,7 +990,9 @@ db_for_all_contents(Objid oid, int (*func) (void *, Objid), void *data)
 {
     Objid c;
 
-    for (c = objects[oid]->contents; c != NOTHING; c = objects[c]->next)
+    for (c = dbpriv_find_object(oid)->contents;
+	 c != NOTHING;
+	 c = dbpriv_find_object(c)->next)
 	if (func(data, c))
 	    return 1;
 
@@ -469,27 +1002,32 @@ db_for_all_contents(Objid oid, int (*func) (void *, Objid), void *data)
 void
 db_change_location(Objid oid, Objid location)
 {
-    Objid old_location = objects[oid]->location;
+    Objid old_location = obj_location(oid);
 
-    if (valid(old_location))
-	LL_REMOVE(old_location, contents, oid, next);
-
-    if (valid(location))
-	LL_APPEND(location, contents, oid, next);
+    if (valid(old_location)) {
+	LL_REMOVE(old_location, contents, last_content, num_contents,
+		  contents_list, oid, next, prev);
+	update_name_index(old_location, oid, 0);
+    }
+    if (valid(location)) {
+	LL_APPEND(location, contents, last_content, num_contents,
+		  contents_list, oid, next, prev);
+	update_name_index(location, oid, 1);
+    }
 
-    objects[oid]->location = location;
+    obj_location(oid) = location;
 }
 
 int
 db_object_has_flag(Objid oid, db_object_flag f)
 {
-    return (objects[oid]->flags & (1 << f)) != 0;
+    return (obj_flags(oid) & (1 << f)) != 0;
 }
 
 void
 db_set_object_flag(Objid oid, db_object_flag f)
 {
-    objects[oid]->flags |= (1 << f);
+    obj_flags(oid) |= (1 << f);
     if (f == FLAG_USER) {
 	Var v;
 
@@ -502,7 +1040,7 @@ db_set_object_flag(Objid oid, db_object_flag f)
 void
 db_clear_object_flag(Objid oid, db_object_flag f)
 {
-    objects[oid]->flags &= ~(1 << f);
+    obj_flags(oid) &= ~(1 << f);
     if (f == FLAG_USER) {
 	Var v;
 
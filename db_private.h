@@ -25,9 +25,11 @@
 #include "structures.h"
 
 typedef struct Verbdef Verbdef;
+typedef struct Verb_Matcher Verb_Matcher;
 
 struct Verbdef {
     const char *name;
+    Verb_Matcher *matcher;	/* name, parsed; see db_verbs.c */
     Program *program;
     Objid owner;
     short perms;
@@ -55,46 +57,127 @@ typedef struct Pval {
     short perms;
 } Pval;
 
+typedef struct Propseg {
+    Objid definer;
+    int length;
+    Pval *vals;			/* for definer's first `length' propdefs */
+    int holder;			/* this object's place in definer's holders */
+} Propseg;
+
+typedef struct Prop_Index Prop_Index;
+				/* A hash table from the names of all the
+				 * properties an object has to where they are
+				 * defined and where their values are in its
+				 * propval array; see db_properties.c.
+				 */
+
+typedef struct Name_Index Name_Index;
+				/* The names and aliases of an object's
+				 * contents, sorted; see db_objects.c.
+				 */
+
+/* The contents of an object are a doubly-linked list through the next and
+ * prev fields of its members, and its children one through sibling and
+ * prev_sibling; each list's first and last members and its length are
+ * kept with the object that owns it, so that moving an object or
+ * changing its parent takes constant time.  Only contents/next and
+ * child/sibling are written to the DB; the rest is rebuilt by
+ * dbpriv_after_load().
+ */
 typedef struct Object {
     Objid id;
-    Objid owner;
-    Objid location;
     Objid contents;
+    Objid last_content;
+    int num_contents;
     Objid next;
+    Objid prev;
+    Var contents_list;		/* of contents, built on demand; TYPE_NONE
+				 * when not built or out of date */
+    Name_Index *name_index;	/* built on demand, 0 when not yet built */
 
-    Objid parent;
     Objid child;
+    Objid last_child;
+    int num_children;
     Objid sibling;
-
+    Objid prev_sibling;
+    Var children_list;		/* likewise, of children */
 
     const char *name;
-    int flags;
 
     Verbdef *verbdefs;
     Proplist propdefs;
-    Pval *propval;
+    Pval *propval;		/* for the properties defined here */
+    Propseg *propsegs;		/* for some of those inherited; see
+				 * db_properties.c */
+    int num_propsegs;
+    Objid *holders;		/* the objects with a Propseg for the
+				 * properties defined here, in no order */
+    int num_holders, max_holders;
+    Prop_Index *prop_index;	/* built on demand, 0 when not yet built
+				 * (stale ones are rebuilt when next used) */
 } Object;
 
+/* The object table.  The fields consulted by valid(), permission checks
+ * and walks up the inheritance hierarchy are kept in parallel arrays
+ * indexed by object number, so that those touch only a few dense arrays;
+ * everything else about an object is in its Object, objects[oid], which
+ * is 0 for a recycled object.
+ */
+typedef struct Object_Table {
+    Object **objects;
+    Objid *owner;
+    Objid *location;
+    Objid *parent;
+    Objid *verb_ancestor;	/* OID or the nearest of its ancestors with
+				 * any verbs, or NOTHING */
+    int *flags;
+    unsigned32 *pre;		/* ancestry labels; see db_objects.c */
+    unsigned32 *post;
+    int num_objects;
+    int max_objects;
+} Object_Table;
+
+extern Object_Table dbpriv_objects;
+
+#define obj_owner(oid)		(dbpriv_objects.owner[oid])
+#define obj_location(oid)	(dbpriv_objects.location[oid])
+#define obj_parent(oid)		(dbpriv_objects.parent[oid])
+#define obj_verb_ancestor(oid)	(dbpriv_objects.verb_ancestor[oid])
+#define obj_flags(oid)		(dbpriv_objects.flags[oid])
+#define obj_pre(oid)		(dbpriv_objects.pre[oid])
+#define obj_post(oid)		(dbpriv_objects.post[oid])
+
+/* Returns 0 if given object is not valid. */
+static inline Object *
+dbpriv_find_object(Objid oid)
+{
+    if ((unsigned) oid >= (unsigned) dbpriv_objects.num_objects)
+	return 0;
+    return dbpriv_objects.objects[oid];
+}
+
 /*********** Verb cache support ***********/
 
 #define VERB_CACHE 1
 
 #ifdef VERB_CACHE
 
-/* Whenever anything is modified that could influence callable verb
- * lookup, this function must be called.
+/* Whenever anything is modified that could influence callable or
+ * command verb lookup, this function must be called, with the object
+ * whose verbs or parent changed; only lookups starting at it or its
+ * descendants are forgotten.  NOTHING forgets them all.
  */
 
 #ifdef RONG
-#define db_priv_affected_callable_verb_lookup() (db_verb_generation++)  
+#define db_priv_affected_callable_verb_lookup(oid) (db_verb_generation++)  
                                  /* The choice of a new generation. */
 extern unsigned int db_verb_generation;
 #endif
 
-extern void db_priv_affected_callable_verb_lookup(void);
+extern void db_priv_affected_callable_verb_lookup(Objid oid);
 
 #else /* no cache */
-#define db_priv_affected_callable_verb_lookup() 
+#define db_priv_affected_callable_verb_lookup(oid) 
 #endif
 
 /*********** Objects ***********/
@@ -116,8 +199,32 @@ extern void dbpriv_new_recycled_object(void);
 				 * using up the next available object number.
 				 */
 
-extern Object *dbpriv_find_object(Objid);
-				/* Returns 0 if given object is not valid.
+extern void dbpriv_after_load(void);
+				/* Fills in the parts of every object that
+				 * aren't stored in the DB file; called once
+				 * the object hierarchies have been read and
+				 * validated.
+				 */
+
+extern void dbpriv_object_names_changed(Objid oid, int inherited);
+				/* Must be called whenever OID's name or
+				 * `aliases' has changed, so that the indexes
+				 * behind db_contents_names() are kept up to
+				 * date; INHERITED says whether OID's
+				 * descendants may see the change too.
+				 */
+
+extern void dbpriv_names_changed(void);
+				/* Makes every one of those indexes stale at
+				 * once, for changes that could alter the
+				 * `aliases' of any number of objects.
+				 */
+
+extern void dbpriv_fix_verb_ancestors(Objid);
+				/* Recomputes obj_verb_ancestor() for the
+				 * given object and all of its descendants;
+				 * must be called whenever an object gains its
+				 * first verb or loses its last one.
 				 */
 
 /*********** Properties ***********/
@@ -126,6 +233,34 @@ extern Propdef dbpriv_new_propdef(const char *name);
 
 extern int dbpriv_count_properties(Objid);
 
+extern Pval dbpriv_propval(Objid oid, Objid definer, int index);
+				/* Returns OID's value for the INDEXth
+				 * property defined on DEFINER, whether or not
+				 * OID holds it itself.
+				 */
+
+extern void dbpriv_split_propvals(void);
+				/* Rearranges the property values of every
+				 * object from the order they're in in the DB
+				 * file; called by dbpriv_after_load().
+				 */
+
+extern void dbpriv_fix_properties_for_chown(Objid);
+				/* The owner of the given object is about to
+				 * change; fix its property values that depend
+				 * on it.
+				 */
+
+extern void dbpriv_props_changed(void);
+				/* Must be called once after each change to
+				 * the names, definers or positions of any
+				 * object's properties, or to which objects
+				 * exist, so that cached lookups are redone
+				 * and property indexes rebuilt.
+				 */
+
+extern void dbpriv_free_prop_index(Object *);
+
 extern int dbpriv_check_properties_for_chparent(Objid oid,
 						Objid new_parent);
 				/* Return true iff NEW_PARENT defines no
@@ -150,6 +285,13 @@ extern void dbpriv_build_prep_table(void);
 				 * prepositional-phrase matching table.
 				 */
 
+extern void dbpriv_set_verb_matcher(Verbdef *);
+				/* Rebuilds the matcher for the verb's name;
+				 * must be called whenever the name is set.
+				 */
+
+extern void dbpriv_free_verb_matcher(Verbdef *);
+
 /*********** DBIO ***********/
 
 extern Exception dbpriv_dbio_failed;
@@ -158,8 +300,69 @@ extern Exception dbpriv_dbio_failed;
 				 */
 
 extern void dbpriv_set_dbio_input(FILE *);
+				/* The rest of the file is mapped (or read)
+				 * into memory and read from there; a null
+				 * pointer lets go of it again.
+				 */
 extern void dbpriv_set_dbio_output(FILE *);
 
+extern void dbpriv_set_dbio_binary_input(int);
+extern void dbpriv_set_dbio_binary_output(int);
+				/* Switch the dbio_read_*() or dbio_write_*()
+				 * routines between the text and binary
+				 * encodings; see db_io.c.  dbio_scanf(),
+				 * dbio_printf() and dbio_read_line() are
+				 * text-only.
+				 */
+
+extern int dbpriv_dbio_input_failed(void);
+				/* True once binary input has run out before
+				 * the end of something being read, or a
+				 * string length or count has been too big
+				 * for what's left of the input; what was
+				 * read since then is garbage.
+				 */
+
+extern int dbpriv_dbio_count_fits(int);
+extern int dbpriv_dbio_read_count(void);
+				/* Check, or read (as by dbio_read_num()) and
+				 * check, a count of things still to be read;
+				 * a negative count, or one bigger than the
+				 * rest of the input, sets the above and
+				 * reads as zero.
+				 */
+
+extern int dbpriv_dbio_skip(const char *);
+				/* If the input goes on with exactly the given
+				 * string, skip it and return true; otherwise
+				 * consume nothing.
+				 */
+
+extern long dbpriv_dbio_input_pos(void);
+extern long dbpriv_dbio_output_pos(void);
+				/* The current offset in the file; for
+				 * output, only maintained while binary.
+				 */
+
+extern void dbpriv_begin_dbio_record(void);
+extern void dbpriv_end_dbio_record(void);
+				/* Output between these two calls is held
+				 * back and then written after its length (as
+				 * by dbio_write_num()), so that a reader can
+				 * check or skip it.  Binary only.
+				 */
+
+extern long dbpriv_dbio_read_offset(void);
+extern void dbpriv_dbio_write_offset(long);
+extern long dbpriv_dbio_read_fixed_offset(void);
+extern void dbpriv_dbio_write_fixed_offset(long);
+extern void dbpriv_dbio_patch_fixed_offset(long where, long offset);
+				/* File offsets, as unsigned varints or in a
+				 * fixed eight bytes; the latter can later be
+				 * overwritten in place, at the offset WHERE
+				 * they were written.  Binary only.
+				 */
+
 /* 
  * $Log$
  * Revision 1.4  1998/12/14 13:17:37  nop
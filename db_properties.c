@@ -22,8 +22,11 @@
 #include "config.h"
 #include "db.h"
 #include "db_private.h"
+#include "db_tune.h"
 #include "list.h"
+#include "my-string.h"
 #include "storage.h"
+#include "str_intern.h"
 #include "utils.h"
 
 Propdef
@@ -31,7 +34,7 @@ dbpriv_new_propdef(const char *name)
 {
     Propdef newprop;
 
-    newprop.name = str_ref(name);
+    newprop.name = str_intern_name(name);
     newprop.hash = str_hash(name);
     return newprop;
 }
@@ -42,79 +45,494 @@ dbpriv_count_properties(Objid oid)
     Object *o;
     int nprops = 0;
 
-    for (o = dbpriv_find_object(oid); o; o = dbpriv_find_object(o->parent))
+    for (; (o = dbpriv_find_object(oid)); oid = obj_parent(oid))
 	nprops += o->propdefs.cur_length;
 
     return nprops;
 }
 
-static int
-property_defined_at_or_below(const char *pname, int phash, Objid oid)
+/*********** Property values ***********/
+
+/* An object's values for the properties it defines itself are in its
+ * propval array, in the same order as its propdefs.  Its values for the
+ * properties it inherits are kept in one Propseg per defining ancestor,
+ * holding the values for that ancestor's first `length' propdefs; an
+ * object has no Propseg at all for most of its ancestors.  Any value not
+ * held is clear, with the permissions of the nearest ancestor that does
+ * hold one and the owner that adding the property or changing the
+ * object's parent would have given it: the object itself if those
+ * permissions include PF_CHOWN, else that ancestor's owner for it.
+ *
+ * So adding a property to an object, or changing its parent, need not
+ * touch its descendants' values at all, and removing one only touches
+ * those descendants holding a value for it, which the defining object
+ * keeps a list of (its holders).  In exchange, an inherited
+ * slot is filled in before anything it would be computed from changes:
+ * the slot's permissions or owner on the parent (see protect_children()),
+ * the object's own owner (dbpriv_fix_properties_for_chown()), or, for
+ * ancestors it keeps, its parent (dbpriv_fix_properties_after_chparent()).
+ *
+ * In the DB file every object still has a value for each of its
+ * properties, in the order of its own propdefs followed by those of each
+ * ancestor in turn; dbpriv_split_propvals() sorts them out after loading.
+ */
+
+typedef struct {		/* what a db_prop_handle points to */
+    Objid oid;
+    Objid definer;
+    int index;
+    Objid holder;		/* OID or the nearest ancestor holding a */
+    Pval *held;			/* value for the property, and that value */
+} Prop_Slot;
+
+static Propseg *
+find_propseg(Object * o, Objid definer)
 {
-    /* Return true iff some descendant of OID defines a property named PNAME.
+    int i;
+
+    for (i = 0; i < o->num_propsegs; i++)
+	if (o->propsegs[i].definer == definer)
+	    return o->propsegs + i;
+
+    return 0;
+}
+
+static Propseg *
+new_propseg(Object * o, Objid definer)
+{
+    Object *d = dbpriv_find_object(definer);
+    Propseg *s;
+
+    if (o->propsegs)
+	o->propsegs = myrealloc(o->propsegs,
+				(o->num_propsegs + 1) * sizeof(Propseg),
+				M_PVAL);
+    else
+	o->propsegs = mymalloc(sizeof(Propseg), M_PVAL);
+    s = o->propsegs + o->num_propsegs++;
+    s->definer = definer;
+    s->length = 0;
+    s->vals = 0;
+
+    if (d->num_holders == d->max_holders) {
+	d->max_holders = d->max_holders ? 2 * d->max_holders : 4;
+	if (d->holders)
+	    d->holders = myrealloc(d->holders,
+				   d->max_holders * sizeof(Objid), M_PVAL);
+	else
+	    d->holders = mymalloc(d->max_holders * sizeof(Objid), M_PVAL);
+    }
+    s->holder = d->num_holders;
+    d->holders[d->num_holders++] = o->id;
+
+    return s;
+}
+
+static void
+free_propseg(Object * o, Propseg * s)
+{
+    Object *d = dbpriv_find_object(s->definer);
+    Objid last = d->holders[--d->num_holders];
+    int i;
+
+    if (last != o->id) {	/* move LAST into O's place */
+	d->holders[s->holder] = last;
+	find_propseg(dbpriv_find_object(last), s->definer)->holder
+	    = s->holder;
+    }
+    if (d->num_holders == 0) {
+	myfree(d->holders, M_PVAL);
+	d->holders = 0;
+	d->max_holders = 0;
+    }
+
+    for (i = 0; i < s->length; i++)
+	free_var(s->vals[i].var);
+    if (s->vals)
+	myfree(s->vals, M_PVAL);
+    *s = o->propsegs[--o->num_propsegs];
+    if (o->num_propsegs == 0) {
+	myfree(o->propsegs, M_PVAL);
+	o->propsegs = 0;
+    }
+}
+
+static Pval *
+find_pval(Objid oid, Objid definer, int index)
+{
+    /* Return OID's value for property INDEX of DEFINER, or null if it
+     * doesn't hold one.
      */
-    Objid c;
-    Proplist *props = &dbpriv_find_object(oid)->propdefs;
-    int length = props->cur_length;
+    Object *o = dbpriv_find_object(oid);
+    Propseg *s;
+
+    if (oid == definer)
+	return o->propval + index;
+    s = find_propseg(o, definer);
+    return s && index < s->length ? s->vals + index : 0;
+}
+
+static void
+inherited_pval(Objid oid, Objid from, Objid definer, int index, Pval * pv)
+{
+    /* Fill in PV with the value OID has for property INDEX of DEFINER when
+     * it holds none, with FROM the first of its ancestors to consult.
+     */
+    Pval *p;
+
+    while (!(p = find_pval(from, definer, index)))
+	from = obj_parent(from);
+
+    pv->var.type = TYPE_CLEAR;
+    pv->perms = p->perms;
+    pv->owner = (p->perms & PF_CHOWN) ? obj_owner(oid) : p->owner;
+}
+
+static Pval *
+hold_pval(Objid oid, Objid from, Objid definer, int index)
+{
+    /* Make OID hold its value for property INDEX of DEFINER, filling in any
+     * it didn't hold before as inherited via FROM, and return it.
+     */
+    Object *o = dbpriv_find_object(oid);
+    Propseg *s;
     int i;
 
-    for (i = 0; i < length; i++)
-	if (props->l[i].hash == phash
-	    && !mystrcasecmp(props->l[i].name, pname))
-	    return 1;
+    if (oid == definer)
+	return o->propval + index;
+    if (!(s = find_propseg(o, definer)))
+	s = new_propseg(o, definer);
+    if (index >= s->length) {
+	if (s->vals)
+	    s->vals = myrealloc(s->vals, (index + 1) * sizeof(Pval), M_PVAL);
+	else
+	    s->vals = mymalloc((index + 1) * sizeof(Pval), M_PVAL);
+	for (i = s->length; i <= index; i++)
+	    inherited_pval(oid, from, definer, i, s->vals + i);
+	s->length = index + 1;
+    }
+
+    return s->vals + index;
+}
+
+Pval
+dbpriv_propval(Objid oid, Objid definer, int index)
+{
+    Pval *p = find_pval(oid, definer, index);
+    Pval pv;
+
+    if (p)
+	return *p;
+    inherited_pval(oid, obj_parent(oid), definer, index, &pv);
+    return pv;
+}
+
+static void
+protect_children(Objid oid, Objid definer, int index)
+{
+    /* The permissions or owner of OID's value for property INDEX of DEFINER
+     * are about to change; make sure its children don't change with it.
+     */
+    Objid c;
 
     for (c = dbpriv_find_object(oid)->child;
 	 c != NOTHING;
 	 c = dbpriv_find_object(c)->sibling)
-	if (property_defined_at_or_below(pname, phash, c))
-	    return 1;
-
-    return 0;
+	if (!find_pval(c, definer, index))
+	    hold_pval(c, oid, definer, index);
 }
 
 static void
-insert_prop(Objid oid, int pos, Pval pval)
+hold_slot(Prop_Slot * slot)
+{
+    if (slot->holder != slot->oid) {
+	slot->holder = slot->oid;
+	slot->held = hold_pval(slot->oid, obj_parent(slot->oid),
+			       slot->definer, slot->index);
+    }
+}
+
+void
+dbpriv_fix_properties_for_chown(Objid oid)
+{
+    Objid a;
+    int i;
+
+    for (a = obj_parent(oid); a != NOTHING; a = obj_parent(a))
+	for (i = 0; i < dbpriv_find_object(a)->propdefs.cur_length; i++)
+	    if (!find_pval(oid, a, i)) {
+		Pval pv;
+
+		inherited_pval(oid, obj_parent(oid), a, i, &pv);
+		if (pv.perms & PF_CHOWN)
+		    hold_pval(oid, obj_parent(oid), a, i);
+	    }
+}
+
+static int
+is_inherited(Objid oid, Pval * p, Pval * parent)
+{
+    return (p->var.type == TYPE_CLEAR
+	    && p->perms == parent->perms
+	    && p->owner == ((parent->perms & PF_CHOWN)
+			    ? obj_owner(oid) : parent->owner));
+}
+
+void
+dbpriv_split_propvals(void)
 {
-    Pval *new_propval;
+    Object **objects = dbpriv_objects.objects;
+    Objid oid, a;
+
+    /* As loaded, each object's propval holds all of its values in DB file
+     * order.  Move the inherited ones into Propsegs, leaving out those
+     * that are just as they would be inherited from its parent's.
+     */
+    for (oid = 0; oid < dbpriv_objects.num_objects; oid++) {
+	Object *o = objects[oid];
+	int n, k;
+
+	if (!o || obj_parent(oid) == NOTHING)
+	    continue;
+
+	n = o->propdefs.cur_length;
+	for (a = obj_parent(oid); a != NOTHING; a = obj_parent(a)) {
+	    Pval *vals = o->propval + n;
+	    Pval *parent_vals = (objects[obj_parent(oid)]->propval
+				 + n - o->propdefs.cur_length);
+	    int length = objects[a]->propdefs.cur_length;
+
+	    for (k = length; k > 0; k--)
+		if (!is_inherited(oid, vals + k - 1, parent_vals + k - 1))
+		    break;
+	    if (k > 0) {
+		Propseg *s = new_propseg(o, a);
+
+		s->length = k;
+		s->vals = mymalloc(k * sizeof(Pval), M_PVAL);
+		memcpy(s->vals, vals, k * sizeof(Pval));
+	    }
+	    n += length;
+	}
+    }
+
+    for (oid = 0; oid < dbpriv_objects.num_objects; oid++) {
+	Object *o = objects[oid];
+
+	if (!o || obj_parent(oid) == NOTHING)
+	    continue;
+	if (o->propdefs.cur_length)
+	    o->propval = myrealloc(o->propval,
+				   o->propdefs.cur_length * sizeof(Pval),
+				   M_PVAL);
+	else if (o->propval) {
+	    myfree(o->propval, M_PVAL);
+	    o->propval = 0;
+	}
+    }
+}
+
+/*********** Property indexes ***********/
+
+/* Finding a property by scanning the propdefs of an object and each of its
+ * ancestors in turn costs time proportional to the number of properties
+ * they define between them, which for the descendants of a large generic
+ * can be hundreds.  So every object with children gets, the first time a
+ * lookup passes through it, a hash table of all the properties it has,
+ * giving for each the object defining it and its position among that
+ * object's propdefs.  A lookup then only scans the propdefs of the object
+ * it starts from, if that has no children, before jumping into its
+ * parent's index.
+ *
+ * An index depends on the propdefs of its object and all of that object's
+ * ancestors, so it goes stale whenever one of those is added, removed or
+ * renamed, or the object or one of its ancestors is reparented or
+ * renumbered.  Rather than find and throw away every index such a change
+ * affects, each records the prop_generation it was built in, and
+ * dbpriv_props_changed() bumps that; an index from an older generation
+ * is rebuilt the next time a lookup comes to it.
+ */
+
+static unsigned prop_generation = 1;
+
+typedef struct {
+    const char *name;		/* 0 for an empty slot */
+    int hash;
+    Objid definer;
+    int index;			/* in definer->propdefs */
+} Prop_Index_Entry;
+
+struct Prop_Index {
+    unsigned generation;	/* prop_generation when built */
+    int mask;			/* number of slots - 1, a power of 2 */
+    Prop_Index_Entry slots[1];
+};
+
+static Prop_Index_Entry *
+prop_index_probe(Prop_Index * index, const char *name, int hash)
+{
+    /* Return the slot in INDEX holding the property NAME, or else the empty
+     * slot where it would go.
+     */
+    unsigned i = (unsigned) hash & index->mask;
+    Prop_Index_Entry *e;
+
+    while ((e = &index->slots[i])->name
+	   && e->name != name
+	   && (e->hash != hash || mystrcasecmp(e->name, name)))
+	i = (i + 1) & index->mask;
+
+    return e;
+}
+
+static Prop_Index *
+build_prop_index(Objid oid)
+{
+    Prop_Index *index;
     Object *o;
-    int i, nprops;
+    Objid a;
+    int nprops = dbpriv_count_properties(oid);
+    int size, i;
+
+    for (size = 8; size < 2 * nprops; size *= 2)
+	;
+    index = mymalloc(sizeof(Prop_Index)
+		     + (size - 1) * sizeof(Prop_Index_Entry), M_PROP_INDEX);
+    index->generation = prop_generation;
+    index->mask = size - 1;
+    for (i = 0; i < size; i++)
+	index->slots[i].name = 0;
+
+    for (a = oid; (o = dbpriv_find_object(a)); a = obj_parent(a))
+	for (i = 0; i < o->propdefs.cur_length; i++) {
+	    Propdef *d = &o->propdefs.l[i];
+	    Prop_Index_Entry *e = prop_index_probe(index, d->name, d->hash);
+
+	    if (!e->name) {	/* the nearest definition wins */
+		e->name = d->name;
+		e->hash = d->hash;
+		e->definer = a;
+		e->index = i;
+	    }
+	}
 
-    nprops = dbpriv_count_properties(oid);
-    new_propval = mymalloc(nprops * sizeof(Pval), M_PVAL);
+    return dbpriv_find_object(oid)->prop_index = index;
+}
 
-    o = dbpriv_find_object(oid);
+/*********** Property lookup cache ***********/
 
-    for (i = 0; i < pos; i++)
-	new_propval[i] = o->propval[i];
+/* Even with the indexes, a lookup scans the propdefs of a childless
+ * object before probing its parent's index, and one that fails pays for
+ * all of that every time; MOO code probing for optional properties fails
+ * a lot.  So the results of recent lookups, failures included, are kept
+ * in a direct-mapped table keyed on the object and property name.  The
+ * whole table goes stale along with the indexes, when prop_generation is
+ * bumped.
+ */
+
+#define PROP_CACHE_SIZE 4096	/* a power of 2 */
+
+typedef struct {
+    Objid oid;
+    const char *name;		/* interned; 0 if never used */
+    int hash;
+    unsigned generation;
+    Objid definer;		/* NOTHING if OID has no such property */
+    int index;
+} Prop_Cache_Entry;
+
+static Prop_Cache_Entry prop_cache[PROP_CACHE_SIZE];
 
-    new_propval[pos] = pval;
-    new_propval[pos].var = var_ref(pval.var);
-    if (new_propval[pos].perms & PF_CHOWN)
-	new_propval[pos].owner = o->owner;
+static int prop_cache_hit = 0;
+static int prop_cache_neg_hit = 0;
+static int prop_cache_miss = 0;
 
-    for (i = pos + 1; i < nprops; i++)
-	new_propval[i] = o->propval[i - 1];
+static inline Prop_Cache_Entry *
+prop_cache_entry(Objid oid, int hash)
+{
+    unsigned h = (unsigned) hash ^ ((unsigned) oid * 0x9E3779B1U);
 
-    if (o->propval)
-	myfree(o->propval, M_PVAL);
-    o->propval = new_propval;
+    return &prop_cache[(h ^ (h >> 16)) & (PROP_CACHE_SIZE - 1)];
 }
 
 static void
-insert_prop_recursively(Objid root, int root_pos, Pval pv)
+fill_prop_cache(Prop_Cache_Entry * pc, Objid oid, const char *name, int hash,
+		Objid definer, int index)
 {
+    if (pc->name)
+	free_str(pc->name);
+    pc->oid = oid;
+    pc->name = str_intern_name(name);
+    pc->hash = hash;
+    pc->generation = prop_generation;
+    pc->definer = definer;
+    pc->index = index;
+}
+
+Var
+db_property_cache_stats(void)
+{
+    Var v;
+
+    v = new_list(4);
+    v.v.list[1].type = TYPE_INT;
+    v.v.list[1].v.num = prop_cache_hit;
+    v.v.list[2].type = TYPE_INT;
+    v.v.list[2].v.num = prop_cache_neg_hit;
+    v.v.list[3].type = TYPE_INT;
+    v.v.list[3].v.num = prop_cache_miss;
+    v.v.list[4].type = TYPE_INT;
+    v.v.list[4].v.num = prop_generation;
+    return v;
+}
+
+void
+dbpriv_props_changed(void)
+{
+    if (++prop_generation == 0) {	/* wrapped; forget everything */
+	Objid oid;
+	int i;
+
+	for (i = 0; i < PROP_CACHE_SIZE; i++)
+	    prop_cache[i].generation = 0;
+	for (oid = 0; oid < dbpriv_objects.num_objects; oid++)
+	    if (dbpriv_objects.objects[oid])
+		dbpriv_free_prop_index(dbpriv_objects.objects[oid]);
+	prop_generation = 1;
+    }
+}
+
+void
+dbpriv_free_prop_index(Object * o)
+{
+    if (o->prop_index) {
+	myfree(o->prop_index, M_PROP_INDEX);
+	o->prop_index = 0;
+    }
+}
+
+static int
+property_defined_at_or_below(const char *pname, int phash, Objid oid)
+{
+    /* Return true iff some descendant of OID defines a property named PNAME.
+     */
     Objid c;
+    Proplist *props = &dbpriv_find_object(oid)->propdefs;
+    int length = props->cur_length;
+    int i;
 
-    insert_prop(root, root_pos, pv);
-    pv.var.type = TYPE_CLEAR;	/* do after initial insert_prop so only
-				   children will be TYPE_CLEAR */
-    for (c = dbpriv_find_object(root)->child;
+    for (i = 0; i < length; i++)
+	if (props->l[i].hash == phash
+	    && !mystrcasecmp(props->l[i].name, pname))
+	    return 1;
+
+    for (c = dbpriv_find_object(oid)->child;
 	 c != NOTHING;
-	 c = dbpriv_find_object(c)->sibling) {
-	int new_prop_count = dbpriv_find_object(c)->propdefs.cur_length;
+	 c = dbpriv_find_object(c)->sibling)
+	if (property_defined_at_or_below(pname, phash, c))
+	    return 1;
 
-	insert_prop_recursively(c, new_prop_count + root_pos, pv);
-    }
+    return 0;
 }
 
 int
@@ -122,7 +540,7 @@ db_add_propdef(Objid oid, const char *pname, Var value, Objid owner,
 	       unsigned flags)
 {
     Object *o;
-    Pval pval;
+    Pval *pval;
     int i;
     db_prop_handle h;
 
@@ -144,14 +562,24 @@ db_add_propdef(Objid oid, const char *pname, Var value, Objid owner,
 
 	if (old_props)
 	    myfree(old_props, M_PROPDEF);
+
+	if (o->propval)
+	    o->propval = myrealloc(o->propval, new_size * sizeof(Pval),
+				   M_PVAL);
+	else
+	    o->propval = mymalloc(new_size * sizeof(Pval), M_PVAL);
     }
-    o->propdefs.l[o->propdefs.cur_length++] = dbpriv_new_propdef(pname);
+    o->propdefs.l[o->propdefs.cur_length] = dbpriv_new_propdef(pname);
 
-    pval.var = value;
-    pval.owner = owner;
-    pval.perms = flags;
+    /* Descendants inherit the new property without being touched. */
+    pval = o->propval + o->propdefs.cur_length++;
+    pval->var = var_ref(value);
+    pval->owner = (flags & PF_CHOWN) ? obj_owner(oid) : owner;
+    pval->perms = flags;
 
-    insert_prop_recursively(oid, o->propdefs.cur_length - 1, pval);
+    dbpriv_props_changed();
+    if (!mystrcasecmp(pname, "aliases"))
+	dbpriv_names_changed();
 
     return 1;
 }
@@ -177,8 +605,11 @@ db_rename_propdef(Objid oid, const char *old, const char *new)
 		    return 0;
 	    }
 	    free_str(props->l[i].name);
-	    props->l[i].name = str_ref(new);
+	    props->l[i].name = str_intern_name(new);
 	    props->l[i].hash = str_hash(new);
+	    dbpriv_props_changed();
+	    if (!mystrcasecmp(old, "aliases") || !mystrcasecmp(new, "aliases"))
+		dbpriv_names_changed();
 
 	    return 1;
 	}
@@ -188,50 +619,37 @@ db_rename_propdef(Objid oid, const char *old, const char *new)
 }
 
 static void
-remove_prop(Objid oid, int pos)
-{
-    Pval *new_propval;
-    Object *o;
-    int i, nprops;
-
-    o = dbpriv_find_object(oid);
-    nprops = dbpriv_count_properties(oid);
-
-    free_var(o->propval[pos].var);	/* free deleted property */
-
-    if (nprops) {
-	new_propval = mymalloc(nprops * sizeof(Pval), M_PVAL);
-	for (i = 0; i < pos; i++)
-	    new_propval[i] = o->propval[i];
-	for (i = pos; i < nprops; i++)
-	    new_propval[i] = o->propval[i + 1];
-    } else
-	new_propval = 0;
-
-    if (o->propval)
-	myfree(o->propval, M_PVAL);
-    o->propval = new_propval;
-}
-
-static void
-remove_prop_recursively(Objid root, int root_pos)
+remove_held_values(Objid definer, int pos)
 {
-    Objid c;
-
-    remove_prop(root, root_pos);
-    for (c = dbpriv_find_object(root)->child;
-	 c != NOTHING;
-	 c = dbpriv_find_object(c)->sibling) {
-	int new_prop_count = dbpriv_find_object(c)->propdefs.cur_length;
+    /* Property POS of DEFINER has gone; drop it from the values of the
+     * descendants holding any.
+     */
+    Object *d = dbpriv_find_object(definer);
+    int i;
 
-	remove_prop_recursively(c, new_prop_count + root_pos);
+    /* Backwards, since free_propseg() moves the last holder into the
+     * place of the one it removes.
+     */
+    for (i = d->num_holders - 1; i >= 0; i--) {
+	Object *o = dbpriv_find_object(d->holders[i]);
+	Propseg *s = find_propseg(o, definer);
+
+	if (pos < s->length) {
+	    free_var(s->vals[pos].var);
+	    if (--s->length == 0)
+		free_propseg(o, s);
+	    else
+		memmove(s->vals + pos, s->vals + pos + 1,
+			(s->length - pos) * sizeof(Pval));
+	}
     }
 }
 
 int
 db_delete_propdef(Objid oid, const char *pname)
 {
-    Proplist *props = &dbpriv_find_object(oid)->propdefs;
+    Object *o = dbpriv_find_object(oid);
+    Proplist *props = &o->propdefs;
     int hash = str_hash(pname);
     int count = props->cur_length;
     int max = props->max_length;
@@ -244,27 +662,28 @@ db_delete_propdef(Objid oid, const char *pname)
 	if (p.hash == hash && !mystrcasecmp(p.name, pname)) {
 	    if (p.name)
 		free_str(p.name);
+	    free_var(o->propval[i].var);
+
+	    for (j = i + 1; j < count; j++) {
+		props->l[j - 1] = props->l[j];
+		o->propval[j - 1] = o->propval[j];
+	    }
+	    props->cur_length--;
 
 	    if (max > 8 && props->cur_length <= ((max * 3) / 8)) {
 		int new_size = max / 2;
-		Propdef *new_props;
-
-		new_props = mymalloc(new_size * sizeof(Propdef), M_PROPDEF);
 
-		for (j = 0; j < i; j++)
-		    new_props[j] = props->l[j];
-		for (j = i + 1; j < count; j++)
-		    new_props[j - 1] = props->l[j];
-
-		myfree(props->l, M_PROPDEF);
-		props->l = new_props;
+		props->l = myrealloc(props->l, new_size * sizeof(Propdef),
+				     M_PROPDEF);
+		o->propval = myrealloc(o->propval, new_size * sizeof(Pval),
+				       M_PVAL);
 		props->max_length = new_size;
-	    } else
-		for (j = i + 1; j < count; j++)
-		    props->l[j - 1] = props->l[j];
+	    }
 
-	    props->cur_length--;
-	    remove_prop_recursively(oid, i);
+	    remove_held_values(oid, i);
+	    dbpriv_props_changed();
+	    if (!mystrcasecmp(pname, "aliases"))
+		dbpriv_names_changed();
 
 	    return 1;
 	}
@@ -293,23 +712,6 @@ db_for_all_propdefs(Objid oid, int (*func) (void *, const char *), void *data)
     return 0;
 }
 
-struct contents_data {
-    Var r;
-    int i;
-};
-
-static int
-add_to_list(void *data, Objid c)
-{
-    struct contents_data *d = data;
-
-    d->i++;
-    d->r.v.list[d->i].type = TYPE_OBJ;
-    d->r.v.list[d->i].v.obj = c;
-
-    return 0;
-}
-
 static void
 get_bi_value(db_prop_handle h, Var * value)
 {
@@ -349,15 +751,7 @@ get_bi_value(db_prop_handle h, Var * value)
 	value->v.obj = db_object_location(oid);
 	break;
     case BP_CONTENTS:
-	{
-	    struct contents_data d;
-
-	    d.r = new_list(db_count_contents(oid));
-	    d.i = 0;
-	    db_for_all_contents(oid, add_to_list, &d);
-
-	    *value = d.r;
-	}
+	*value = db_object_contents(oid);
 	break;
     default:
 	panic("Unknown built-in property in GET_BI_VALUE!");
@@ -366,6 +760,13 @@ get_bi_value(db_prop_handle h, Var * value)
 
 db_prop_handle
 db_find_property(Objid oid, const char *name, Var * value)
+{
+    return db_find_property_hashed(oid, name, str_hash(name), value);
+}
+
+db_prop_handle
+db_find_property_hashed(Objid oid, const char *name, unsigned phash,
+			Var * value)
 {
     static struct {
 	const char *name;
@@ -377,10 +778,13 @@ db_find_property(Objid oid, const char *name, Var * value)
 #undef _ENTRY
     };
     static int ptable_init = 0;
-    int i, n;
+    static Prop_Slot slot;
+    int i;
     db_prop_handle h;
-    int hash = str_hash(name);
+    int hash = phash;
+    Objid a;
     Object *o;
+    Prop_Cache_Entry *pc;
 
     if (!ptable_init) {
 	for (i = 0; i < Arraysize(ptable); i++)
@@ -402,36 +806,97 @@ db_find_property(Objid oid, const char *name, Var * value)
     }
 
     h.built_in = BP_NONE;
-    n = 0;
-    for (o = dbpriv_find_object(oid); o; o = dbpriv_find_object(o->parent)) {
+    if (!dbpriv_find_object(oid)) {
+	h.ptr = 0;
+	return h;
+    }
+    pc = prop_cache_entry(oid, hash);
+    if (pc->generation == prop_generation && pc->oid == oid
+	&& (pc->name == name
+	    || (pc->hash == hash && !mystrcasecmp(pc->name, name)))) {
+	if (pc->definer == NOTHING) {
+	    prop_cache_neg_hit++;
+	    h.ptr = 0;
+	    return h;
+	}
+	prop_cache_hit++;
+	h.definer = pc->definer;
+	i = pc->index;
+	goto found;
+    }
+    prop_cache_miss++;
+
+    for (a = oid; (o = dbpriv_find_object(a)); a = obj_parent(a)) {
 	Proplist *props = &(o->propdefs);
 	Propdef *defs = props->l;
 	int length = props->cur_length;
 
-	for (i = 0; i < length; i++, n++) {
-	    if (defs[i].hash == hash
-		&& !mystrcasecmp(defs[i].name, name)) {
-		Pval *prop;
-
-		h.definer = o->id;
-		o = dbpriv_find_object(oid);
-		prop = h.ptr = o->propval + n;
-
-		if (value) {
-		    while (prop->var.type == TYPE_CLEAR) {
-			n -= o->propdefs.cur_length;
-			o = dbpriv_find_object(o->parent);
-			prop = o->propval + n;
-		    }
-		    *value = prop->var;
-		}
-		return h;
+	if (o->prop_index && o->prop_index->generation != prop_generation)
+	    dbpriv_free_prop_index(o);
+	if (o->prop_index || o->child != NOTHING) {
+	    Prop_Index *index = o->prop_index;
+	    Prop_Index_Entry *e;
+
+	    if (!index)
+		index = build_prop_index(a);
+	    e = prop_index_probe(index, name, hash);
+	    if (!e->name)
+		break;
+	    h.definer = e->definer;
+	    i = e->index;
+	    goto defined;
+	}
+	for (i = 0; i < length; i++) {
+	    if (defs[i].name == name
+		|| (defs[i].hash == hash
+		    && !mystrcasecmp(defs[i].name, name))) {
+		h.definer = a;
+		goto defined;
 	    }
 	}
     }
 
+    fill_prop_cache(pc, oid, name, hash, NOTHING, 0);
     h.ptr = 0;
     return h;
+
+  defined:
+    fill_prop_cache(pc, oid, name, hash, h.definer, i);
+  found:
+    slot.oid = oid;
+    slot.definer = h.definer;
+    slot.index = i;
+    slot.held = 0;
+    h.ptr = &slot;
+
+    for (a = oid;; a = obj_parent(a)) {
+	Pval *prop;
+
+	o = dbpriv_objects.objects[a];
+	if (a == h.definer)
+	    prop = o->propval + i;
+	else if (o->num_propsegs) {
+	    Propseg *s = find_propseg(o, h.definer);
+
+	    if (!s || i >= s->length)
+		continue;
+	    prop = s->vals + i;
+	} else
+	    continue;
+
+	if (!slot.held) {
+	    slot.holder = a;
+	    slot.held = prop;
+	    if (!value)
+		break;
+	}
+	if (prop->var.type != TYPE_CLEAR || a == h.definer) {
+	    *value = prop->var;
+	    break;
+	}
+    }
+
+    return h;
 }
 
 Var
@@ -442,9 +907,12 @@ db_property_value(db_prop_handle h)
     if (h.built_in)
 	get_bi_value(h, &value);
     else {
-	Pval *prop = h.ptr;
+	Prop_Slot *slot = h.ptr;
 
-	value = prop->var;
+	if (slot->holder == slot->oid)
+	    value = slot->held->var;
+	else
+	    value.type = TYPE_CLEAR;
     }
 
     return value;
@@ -454,10 +922,29 @@ void
 db_set_property_value(db_prop_handle h, Var value)
 {
     if (!h.built_in) {
-	Pval *prop = h.ptr;
-
-	free_var(prop->var);
-	prop->var = value;
+	static int aliases_hash = 0;
+	Prop_Slot *slot = h.ptr;
+	Objid oid = slot->oid;
+	Propdef *d = dbpriv_find_object(slot->definer)->propdefs.l
+	    + slot->index;
+	int changed = 1;
+
+	if (slot->holder != slot->oid) {
+	    if (value.type == TYPE_CLEAR)
+		return;
+	    hold_slot(slot);
+	} else
+	    changed = (slot->held->var.type != value.type
+		       || (value.type != TYPE_CLEAR
+			   && !equality(slot->held->var, value, 1)));
+	free_var(slot->held->var);
+	slot->held->var = value;
+
+	if (!aliases_hash)
+	    aliases_hash = str_hash("aliases");
+	if (changed && d->hash == aliases_hash
+	    && !mystrcasecmp(d->name, "aliases"))
+	    dbpriv_object_names_changed(oid, 1);
     } else {
 	Objid oid = *((Objid *) h.ptr);
 	db_object_flag flag;
@@ -512,9 +999,12 @@ db_property_owner(db_prop_handle h)
 	panic("Built-in property in DB_PROPERTY_OWNER!");
 	return NOTHING;
     } else {
-	Pval *prop = h.ptr;
+	Prop_Slot *slot = h.ptr;
 
-	return prop->owner;
+	if (slot->holder == slot->oid || !(slot->held->perms & PF_CHOWN))
+	    return slot->held->owner;
+	else
+	    return obj_owner(slot->oid);
     }
 }
 
@@ -524,9 +1014,14 @@ db_set_property_owner(db_prop_handle h, Objid oid)
     if (h.built_in)
 	panic("Built-in property in DB_SET_PROPERTY_OWNER!");
     else {
-	Pval *prop = h.ptr;
-
-	prop->owner = oid;
+	Prop_Slot *slot = h.ptr;
+
+	if (db_property_owner(h) == oid)
+	    return;
+	if (!(slot->held->perms & PF_CHOWN))
+	    protect_children(slot->oid, slot->definer, slot->index);
+	hold_slot(slot);
+	slot->held->owner = oid;
     }
 }
 
@@ -537,9 +1032,9 @@ db_property_flags(db_prop_handle h)
 	panic("Built-in property in DB_PROPERTY_FLAGS!");
 	return 0;
     } else {
-	Pval *prop = h.ptr;
+	Prop_Slot *slot = h.ptr;
 
-	return prop->perms;
+	return slot->held->perms;
     }
 }
 
@@ -549,9 +1044,13 @@ db_set_property_flags(db_prop_handle h, unsigned flags)
     if (h.built_in)
 	panic("Built-in property in DB_SET_PROPERTY_FLAGS!");
     else {
-	Pval *prop = h.ptr;
+	Prop_Slot *slot = h.ptr;
 
-	prop->perms = flags;
+	if (slot->held->perms == flags)
+	    return;
+	protect_children(slot->oid, slot->definer, slot->index);
+	hold_slot(slot);
+	slot->held->perms = flags;
     }
 }
 
@@ -564,44 +1063,25 @@ db_property_allows(db_prop_handle h, Objid progr, db_prop_flag flag)
 }
 
 static void
-fix_props(Objid oid, int parent_local, int old, int new, int common)
+drop_propsegs(Objid oid, Objid old_parent, Objid common)
 {
-    Object *me = dbpriv_find_object(oid);
-    Object *parent = dbpriv_find_object(me->parent);
-    Pval *new_propval;
-    int local = parent_local;
+    /* OID has just changed parent away from OLD_PARENT; forget its values
+     * and those of its descendants for the properties defined by its old
+     * ancestors below COMMON, which they no longer have.
+     */
+    Objid a;
     int i;
-    Objid c;
-
-    local += me->propdefs.cur_length;
 
-    for (i = local; i < local + old; i++)
-	free_var(me->propval[i].var);
-
-    if (local + new + common != 0) {
-	new_propval = mymalloc((local + new + common) * sizeof(Pval), M_PVAL);
-	for (i = 0; i < local; i++)
-	    new_propval[i] = me->propval[i];
-	for (i = 0; i < new; i++) {
-	    Pval pv;
-
-	    pv = parent->propval[parent_local + i];
-	    new_propval[local + i] = pv;
-	    new_propval[local + i].var.type = TYPE_CLEAR;
-	    if (pv.perms & PF_CHOWN)
-		new_propval[local + i].owner = me->owner;
-	}
-	for (i = 0; i < common; i++)
-	    new_propval[local + new + i] = me->propval[local + old + i];
-    } else
-	new_propval = 0;
+    for (a = old_parent; a != common; a = obj_parent(a)) {
+	Object *d = dbpriv_find_object(a);
 
-    if (me->propval)
-	myfree(me->propval, M_PVAL);
-    me->propval = new_propval;
+	for (i = d->num_holders - 1; i >= 0; i--)
+	    if (db_object_isa(d->holders[i], oid)) {
+		Object *o = dbpriv_find_object(d->holders[i]);
 
-    for (c = me->child; c != NOTHING; c = dbpriv_find_object(c)->sibling)
-	fix_props(c, local, old, new, common);
+		free_propseg(o, find_propseg(o, a));
+	    }
+    }
 }
 
 int
@@ -610,9 +1090,8 @@ dbpriv_check_properties_for_chparent(Objid oid, Objid new_parent)
     Object *o;
     int i;
 
-    for (o = dbpriv_find_object(new_parent);
-	 o;
-	 o = dbpriv_find_object(o->parent)) {
+    for (; (o = dbpriv_find_object(new_parent));
+	 new_parent = obj_parent(new_parent)) {
 	Proplist *props = &o->propdefs;
 
 	for (i = 0; i < props->cur_length; i++)
@@ -629,7 +1108,7 @@ void
 dbpriv_fix_properties_after_chparent(Objid oid, Objid old_parent)
 {
     Objid o1, o2, common, new_parent;
-    int common_props, old_props, new_props;
+    int i;
 
     /* Find the nearest common ancestor between old & new parent */
     new_parent = db_object_parent(oid);
@@ -642,15 +1121,23 @@ dbpriv_fix_properties_after_chparent(Objid oid, Objid old_parent)
 	    }
   endouter:
 
-    if (common != NOTHING)
-	common_props = dbpriv_count_properties(common);
-    else
-	common_props = 0;
-
-    old_props = dbpriv_count_properties(old_parent) - common_props;
-    new_props = dbpriv_count_properties(new_parent) - common_props;
+    /* OID keeps the values it had for properties defined at or above the
+     * common ancestor, so hold onto any that it inherited from the old
+     * parent and wouldn't from the new.
+     */
+    for (o1 = common; o1 != NOTHING; o1 = db_object_parent(o1))
+	for (i = 0; i < dbpriv_find_object(o1)->propdefs.cur_length; i++)
+	    if (!find_pval(oid, o1, i)) {
+		Pval old, new;
+
+		inherited_pval(oid, old_parent, o1, i, &old);
+		inherited_pval(oid, new_parent, o1, i, &new);
+		if (old.perms != new.perms || old.owner != new.owner)
+		    hold_pval(oid, old_parent, o1, i);
+	    }
 
-    fix_props(oid, 0, old_props, new_props, common_props);
+    drop_propsegs(oid, old_parent, common);
+    dbpriv_props_changed();
 }
 
 char rcsid_db_properties[] = "$Id$";
@@ -4,3 +4,5 @@
 
 extern void db_log_cache_stats(void);
 extern Var db_verb_cache_stats(void);
+extern void db_set_verb_cache_limit(int bytes);
+extern Var db_property_cache_stats(void);
@@ -29,9 +29,11 @@
 #include "db_tune.h"
 #include "list.h"
 #include "log.h"
+#include "options.h"
 #include "parse_cmd.h"
 #include "program.h"
 #include "storage.h"
+#include "str_intern.h"
 #include "utils.h"
 
 
@@ -194,6 +196,125 @@ db_unparse_prep(db_prep_spec prep)
 #define OBJMASK    0x3
 #define PERMMASK   0xF
 
+/* A verb's name is a list of aliases separated by spaces, in which a `*'
+ * marks how much of the alias may be left off the end of a word that
+ * matches it; a `*' at the very end lets the word continue past the end
+ * of the alias.  Rather than parse this for each verb on each lookup, as
+ * verbcasecmp() does, the name is broken down once into a Verb_Matcher,
+ * with each alias reduced to its characters without the stars, the
+ * fewest of them a matching word may have, and whether the word may have
+ * more; aliases without stars are compared by hash first, and the others
+ * by their first character.
+ */
+
+typedef struct {
+    const char *chars;
+    unsigned hash;		/* str_hash(chars), if exact */
+    int len;
+    int min_len;		/* index of first `*', or len */
+    char exact;			/* no `*' at all */
+    char open;			/* ends with `*' */
+    char first;			/* tolower(chars[0]) */
+} Verb_Alias;
+
+struct Verb_Matcher {
+    int num_aliases;
+    Verb_Alias aliases[1];
+};
+
+void
+dbpriv_free_verb_matcher(Verbdef * v)
+{
+    if (v->matcher) {
+	myfree(v->matcher, M_VERB_MATCHER);
+	v->matcher = 0;
+    }
+}
+
+void
+dbpriv_set_verb_matcher(Verbdef * v)
+{
+    const char *p;
+    char *buf;
+    Verb_Matcher *m;
+    int count, i;
+
+    dbpriv_free_verb_matcher(v);
+
+    /* As in verbcasecmp(), leading spaces make an empty alias, and other
+     * runs of spaces are just separators.
+     */
+    for (count = 0, p = v->name; *p; count++) {
+	while (*p && *p != ' ')
+	    p++;
+	while (*p == ' ')
+	    p++;
+    }
+
+    m = mymalloc(sizeof(Verb_Matcher) + count * sizeof(Verb_Alias)
+		 + strlen(v->name) + 1, M_VERB_MATCHER);
+    m->num_aliases = count;
+    buf = (char *) (m->aliases + count);
+
+    for (i = 0, p = v->name; i < count; i++) {
+	Verb_Alias *a = m->aliases + i;
+	int len = 0;
+
+	a->chars = buf;
+	a->min_len = -1;
+	a->open = 0;
+	for (; *p && *p != ' '; p++)
+	    if (*p == '*') {
+		if (a->min_len < 0)
+		    a->min_len = len;
+		a->open = (p[1] == '\0' || p[1] == ' ');
+	    } else
+		buf[len++] = *p;
+	buf[len] = '\0';
+	buf += len + 1;
+	while (*p == ' ')
+	    p++;
+
+	a->len = len;
+	a->first = tolower((unsigned char) a->chars[0]);
+	a->exact = (a->min_len < 0);
+	if (a->exact) {
+	    a->min_len = len;
+	    a->hash = str_hash(a->chars);
+	}
+    }
+
+    v->matcher = m;
+}
+
+static inline int
+verb_name_matches(Verbdef * v, const char *word, int len, unsigned hash)
+{
+    Verb_Matcher *m = v->matcher;
+    int c = tolower((unsigned char) *word);
+    int i;
+
+    if (v->name == word)
+	return 1;
+
+    for (i = 0; i < m->num_aliases; i++) {
+	Verb_Alias *a = m->aliases + i;
+
+	if (a->exact) {
+	    if (len == a->len && hash == a->hash
+		&& !mystrcasecmp(word, a->chars))
+		return 1;
+	} else if (len >= a->min_len
+		   && (len == 0 || a->len == 0 || c == a->first)
+		   && (len <= a->len
+		       ? !mystrncasecmp(word, a->chars, len)
+		       : a->open && !mystrncasecmp(word, a->chars, a->len)))
+	    return 1;
+    }
+
+    return 0;
+}
+
 int
 db_add_verb(Objid oid, const char *vnames, Objid owner, unsigned flags,
 	    db_arg_spec dobj, db_prep_spec prep, db_arg_spec iobj)
@@ -202,10 +323,13 @@ db_add_verb(Objid oid, const char *vnames, Objid owner, unsigned flags,
     Verbdef *v, *newv;
     int count;
 
-    db_priv_affected_callable_verb_lookup();
+    db_priv_affected_callable_verb_lookup(oid);
 
     newv = mymalloc(sizeof(Verbdef), M_VERBDEF);
-    newv->name = vnames;
+    newv->name = str_intern_name(vnames);
+    newv->matcher = 0;
+    dbpriv_set_verb_matcher(newv);
+    free_str(vnames);
     newv->owner = owner;
     newv->perms = flags | (dobj << DOBJSHIFT) | (iobj << IOBJSHIFT);
     newv->prep = prep;
@@ -217,17 +341,26 @@ db_add_verb(Objid oid, const char *vnames, Objid owner, unsigned flags,
     } else {
 	o->verbdefs = newv;
 	count = 1;
+	dbpriv_fix_verb_ancestors(oid);
     }
     return count;
 }
 
+/* The first of OID and its ancestors with any verbs, or NOTHING. */
+static inline Objid
+verb_ancestor(Objid oid)
+{
+    return dbpriv_find_object(oid) ? obj_verb_ancestor(oid) : NOTHING;
+}
+
 static Verbdef *
-find_verbdef_by_name(Object * o, const char *vname, int check_x_bit)
+find_verbdef_by_name(Object * o, const char *vname, int len, unsigned hash,
+		     int check_x_bit)
 {
     Verbdef *v;
 
     for (v = o->verbdefs; v; v = v->next)
-	if (verbcasecmp(v->name, vname)
+	if (verb_name_matches(v, vname, len, hash)
 	    && (!check_x_bit || (v->perms & VF_EXEC)))
 	    break;
 
@@ -276,12 +409,14 @@ db_delete_verb(db_verb_handle vh)
     Object *o = dbpriv_find_object(oid);
     Verbdef *vv;
 
-    db_priv_affected_callable_verb_lookup();
+    db_priv_affected_callable_verb_lookup(oid);
 
     vv = o->verbdefs;
-    if (vv == v)
+    if (vv == v) {
 	o->verbdefs = v->next;
-    else {
+	if (!o->verbdefs)
+	    dbpriv_fix_verb_ancestors(oid);
+    } else {
 	while (vv->next != v)
 	    vv = vv->next;
 	vv->next = v->next;
@@ -291,40 +426,10 @@ db_delete_verb(db_verb_handle vh)
 	free_program(v->program);
     if (v->name)
 	free_str(v->name);
+    dbpriv_free_verb_matcher(v);
     myfree(v, M_VERBDEF);
 }
 
-db_verb_handle
-db_find_command_verb(Objid oid, const char *verb,
-		     db_arg_spec dobj, unsigned prep, db_arg_spec iobj)
-{
-    Object *o;
-    Verbdef *v;
-    static handle h;
-    db_verb_handle vh;
-
-    for (o = dbpriv_find_object(oid); o; o = dbpriv_find_object(o->parent))
-	for (v = o->verbdefs; v; v = v->next) {
-	    db_arg_spec vdobj = (v->perms >> DOBJSHIFT) & OBJMASK;
-	    db_arg_spec viobj = (v->perms >> IOBJSHIFT) & OBJMASK;
-
-	    if (verbcasecmp(v->name, verb)
-		&& (vdobj == ASPEC_ANY || vdobj == dobj)
-		&& (v->prep == PREP_ANY || v->prep == prep)
-		&& (viobj == ASPEC_ANY || viobj == iobj)) {
-		h.definer = o->id;
-		h.verbdef = v;
-		vh.ptr = &h;
-
-		return vh;
-	    }
-	}
-
-    vh.ptr = 0;
-
-    return vh;
-}
-
 #ifdef VERB_CACHE
 int db_verb_generation = 0;
 
@@ -332,83 +437,324 @@ int verbcache_hit = 0;
 int verbcache_neg_hit = 0;
 int verbcache_miss = 0;
 
-typedef struct vc_entry vc_entry;
+int cmdcache_hit = 0;
+int cmdcache_neg_hit = 0;
+int cmdcache_miss = 0;
+
+/* The verb caches are open-addressed tables of vc_entry, probed
+ * linearly from slot (hash & mask).  A table doubles when it gets three
+ * quarters full, unless that would take the two tables together past
+ * vc_max_bytes; then CLOCK picks an entry to evict instead, sparing those
+ * looked up since the hand last passed them.  Entries are removed by
+ * shifting later members of their run back, so there are no tombstones.
+ */
 
-struct vc_entry {
+typedef struct vc_entry {
+    const char *verbname;	/* interned; NULL in an empty slot */
     unsigned int hash;
 #ifdef RONG
     int generation;
 #endif
     Objid oid_key;		/* Note that we proceed up the parent tree
 				   until we hit an object with verbs on it */
-    char *verbname;
+    int args;			/* CC_ARGS(); command lookups only */
+    char used;			/* looked up since CLOCK last passed it */
     handle h;
-    struct vc_entry *next;
-};
+} vc_entry;
 
-static vc_entry **vc_table = NULL;
-static int vc_size = 0;
+typedef struct {
+    vc_entry *slots;		/* NULL until first used */
+    unsigned mask;		/* number of slots - 1 */
+    int count;
+    unsigned hand;		/* CLOCK hand */
+} vc_table;
+
+/* Command lookups (db_find_command_verb()) are cached separately from
+ * callable ones, since they also match on the argument specifiers and
+ * ignore the x bit.
+ */
+#define CC_ARGS(dobj, prep, iobj) \
+	((((prep) + 2) << 4) | ((iobj) << 2) | (dobj))
 
-#define DEFAULT_VC_SIZE 7507
+static vc_table vc_callable, vc_command;
 
-void
-db_priv_affected_callable_verb_lookup(void)
+static int vc_max_bytes = DEFAULT_MAX_VERB_CACHE_BYTES;
+
+#define VC_INITIAL_SIZE 1024	/* slots; a power of two */
+
+#define VC_CACHE_STATS_MAX 16
+
+static int vc_evicted = 0;
+static int vc_discarded = 0;	/* entries dropped by invalidations */
+static int vc_discard_histogram[VC_CACHE_STATS_MAX + 1];
+				/* [0] counts invalidations that dropped
+				 * nothing, [i] those that dropped from
+				 * 2^(i-1) to 2^i - 1 entries */
+
+static inline unsigned
+vc_hash(unsigned vhash, Objid oid_key, int args)
 {
-    int i;
-    vc_entry *vc, *vc_next;
+    unsigned h = (vhash ^ ((unsigned) oid_key * 0x9E3779B1U)
+		  ^ ((unsigned) args << 24));
+
+    h ^= h >> 16;
+    h *= 0x85EBCA6BU;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35U;
+    h ^= h >> 16;
+    return h;
+}
 
-    if (vc_table == NULL)
-	return;
+static inline int
+vc_bytes(vc_table * t)
+{
+    return t->slots ? (t->mask + 1) * sizeof(vc_entry) : 0;
+}
 
-    db_verb_generation++;
+static void
+vc_alloc(vc_table * t, unsigned size)
+{
+    unsigned i;
+
+    t->slots = mymalloc(size * sizeof(vc_entry), M_VC_TABLE);
+    for (i = 0; i < size; i++)
+	t->slots[i].verbname = NULL;
+    t->mask = size - 1;
+    t->count = 0;
+    t->hand = 0;
+}
+
+static void
+vc_free(vc_table * t)
+{
+    unsigned i;
+
+    if (!t->slots)
+	return;
+    for (i = 0; i <= t->mask; i++)
+	if (t->slots[i].verbname)
+	    free_str(t->slots[i].verbname);
+    myfree(t->slots, M_VC_TABLE);
+    t->slots = NULL;
+    t->count = 0;
+}
 
-    for (i = 0; i < vc_size; i++) {
-	vc = vc_table[i];
-	while (vc) {
-	    vc_next = vc->next;
-	    free_str(vc->verbname);
-	    myfree(vc, M_VC_ENTRY);
-	    vc = vc_next;
+/* Empties slot I, moving later entries of its run back to fill the gap.
+ */
+static void
+vc_remove(vc_table * t, unsigned i)
+{
+    unsigned j, home;
+
+    free_str(t->slots[i].verbname);
+    t->slots[i].verbname = NULL;
+    t->count--;
+
+    for (j = (i + 1) & t->mask; t->slots[j].verbname; j = (j + 1) & t->mask) {
+	home = t->slots[j].hash & t->mask;
+	/* The entry at J can fill I unless its home lies in (I, J]. */
+	if (((j - home) & t->mask) >= ((j - i) & t->mask)) {
+	    t->slots[i] = t->slots[j];
+	    t->slots[j].verbname = NULL;
+	    i = j;
 	}
-	vc_table[i] = NULL;
     }
 }
 
 static void
-make_vc_table(int size)
+vc_evict(vc_table * t)
 {
-    int i;
+    vc_entry *vc;
 
-    vc_size = size;
-    vc_table = mymalloc(size * sizeof(vc_entry *), M_VC_TABLE);
-    for (i = 0; i < size; i++) {
-	vc_table[i] = NULL;
+    for (;; t->hand = (t->hand + 1) & t->mask) {
+	vc = &t->slots[t->hand];
+	if (!vc->verbname)
+	    continue;
+	if (vc->used)
+	    vc->used = 0;
+	else {
+	    vc_remove(t, t->hand);
+	    vc_evicted++;
+	    return;
+	}
     }
 }
 
-#define VC_CACHE_STATS_MAX 16
+static void
+vc_grow(vc_table * t)
+{
+    vc_entry *old = t->slots;
+    unsigned i, j, old_size = t->mask + 1;
+
+    vc_alloc(t, 2 * old_size);
+    for (i = 0; i < old_size; i++)
+	if (old[i].verbname) {
+	    for (j = old[i].hash & t->mask;
+		 t->slots[j].verbname;
+		 j = (j + 1) & t->mask)
+		;
+	    t->slots[j] = old[i];
+	    t->count++;
+	}
+    myfree(old, M_VC_TABLE);
+}
 
-Var
-db_verb_cache_stats(void)
+static vc_entry *
+vc_lookup(vc_table * t, unsigned hash, Objid oid_key, int args,
+	  const char *verb)
+{
+    unsigned i;
+    vc_entry *vc;
+
+    if (!t->slots)
+	return NULL;
+    for (i = hash & t->mask; (vc = &t->slots[i])->verbname;
+	 i = (i + 1) & t->mask)
+	if (hash == vc->hash
+	    && oid_key == vc->oid_key
+	    && args == vc->args
+	    && (verb == vc->verbname || !mystrcasecmp(verb, vc->verbname))) {
+	    vc->used = 1;
+	    return vc;
+	}
+    return NULL;
+}
+
+/* Adds an entry for a failed lookup, for the caller to fill in if the
+ * lookup succeeds.  The entry stays put until the next call to vc_insert()
+ * or db_priv_affected_callable_verb_lookup().
+ */
+static vc_entry *
+vc_insert(vc_table * t, unsigned hash, Objid oid_key, int args,
+	  const char *verb)
 {
-    int i, depth, histogram[VC_CACHE_STATS_MAX + 1];
+    vc_table *other = (t == &vc_callable ? &vc_command : &vc_callable);
+    unsigned i;
     vc_entry *vc;
-    Var v, vv;
 
-    for (i = 0; i < VC_CACHE_STATS_MAX + 1; i++) {
-	histogram[i] = 0;
+    if (!t->slots)
+	vc_alloc(t, VC_INITIAL_SIZE);
+    else if (4 * (t->count + 1) > 3 * (t->mask + 1)) {
+	if (2 * vc_bytes(t) + vc_bytes(other) <= vc_max_bytes)
+	    vc_grow(t);
+	else
+	    vc_evict(t);
+    }
+    for (i = hash & t->mask; t->slots[i].verbname; i = (i + 1) & t->mask)
+	;
+    vc = &t->slots[i];
+    vc->verbname = str_intern_name(verb);
+    vc->hash = hash;
+    vc->oid_key = oid_key;
+    vc->args = args;
+    vc->used = 0;
+    vc->h.verbdef = NULL;
+    t->count++;
+    return vc;
+}
+
+/* Drops the entries for lookups starting at OID or its descendants (all
+ * of them if OID is NOTHING), returning how many there were.  Lookups
+ * from objects without any ancestors with verbs can't be affected by
+ * anything short of that.
+ */
+static int
+clear_vc_table(vc_table * t, Objid oid)
+{
+    unsigned i;
+    int count = 0;
+    vc_entry *vc;
+
+    if (!t->slots)
+	return 0;
+    if (oid == NOTHING) {
+	count = t->count;
+	for (i = 0; i <= t->mask; i++)
+	    if (t->slots[i].verbname) {
+		free_str(t->slots[i].verbname);
+		t->slots[i].verbname = NULL;
+	    }
+	t->count = 0;
+	return count;
+    }
+    /* vc_remove() only moves entries back into the slot just emptied or
+     * into ones it has already checked, so check slot I again. */
+    for (i = 0; i <= t->mask;) {
+	vc = &t->slots[i];
+	if (vc->verbname && vc->oid_key != NOTHING
+	    && db_object_isa(vc->oid_key, oid)) {
+	    vc_remove(t, i);
+	    count++;
+	} else
+	    i++;
+    }
+    return count;
+}
+
+void
+db_priv_affected_callable_verb_lookup(Objid oid)
+{
+    int count, i;
+
+    if (!vc_callable.slots && !vc_command.slots)
+	return;
+
+    db_verb_generation++;
+
+    count = (clear_vc_table(&vc_callable, oid)
+	     + clear_vc_table(&vc_command, oid));
+
+    vc_discarded += count;
+    for (i = 0; count > 0 && i < VC_CACHE_STATS_MAX; count >>= 1)
+	i++;
+    vc_discard_histogram[i]++;
+}
+
+void
+db_set_verb_cache_limit(int bytes)
+{
+    vc_max_bytes = bytes;
+    if (vc_bytes(&vc_callable) + vc_bytes(&vc_command) > bytes) {
+	db_verb_generation++;
+	vc_free(&vc_callable);
+	vc_free(&vc_command);
     }
+}
+
+/* HISTOGRAM[0] counts the empty slots, HISTOGRAM[N] the entries found on
+ * the Nth probe (the last element taking any more).
+ */
+static void
+probe_histogram(vc_table * t, int *histogram)
+{
+    unsigned i, depth;
 
-    for (i = 0; i < vc_size; i++) {
-	depth = 0;
-	for (vc = vc_table[i]; vc; vc = vc->next)
-	    depth++;
-	if (depth > VC_CACHE_STATS_MAX)
-	    depth = VC_CACHE_STATS_MAX;
+    for (i = 0; i < VC_CACHE_STATS_MAX + 1; i++)
+	histogram[i] = 0;
+
+    if (!t->slots)
+	return;
+    for (i = 0; i <= t->mask; i++) {
+	if (!t->slots[i].verbname)
+	    depth = 0;
+	else {
+	    depth = ((i - t->slots[i].hash) & t->mask) + 1;
+	    if (depth > VC_CACHE_STATS_MAX)
+		depth = VC_CACHE_STATS_MAX;
+	}
 	histogram[depth]++;
     }
+}
 
-    v = new_list(5);
+Var
+db_verb_cache_stats(void)
+{
+    int i, histogram[VC_CACHE_STATS_MAX + 1];
+    Var v, vv;
+
+    probe_histogram(&vc_callable, histogram);
+
+    v = new_list(8);
     v.v.list[1].type = TYPE_INT;
     v.v.list[1].v.num = verbcache_hit;
     v.v.list[2].type = TYPE_INT;
@@ -422,30 +768,40 @@ db_verb_cache_stats(void)
 	vv.v.list[i + 1].type = TYPE_INT;
 	vv.v.list[i + 1].v.num = histogram[i];
     }
+    v.v.list[6].type = TYPE_INT;
+    v.v.list[6].v.num = vc_discarded;
+    vv = (v.v.list[7] = new_list(VC_CACHE_STATS_MAX + 1));
+    for (i = 0; i < VC_CACHE_STATS_MAX + 1; i++) {
+	vv.v.list[i + 1].type = TYPE_INT;
+	vv.v.list[i + 1].v.num = vc_discard_histogram[i];
+    }
+    v.v.list[8].type = TYPE_INT;
+    v.v.list[8].v.num = vc_evicted;
     return v;
 }
 
 void
 db_log_cache_stats(void)
 {
-    int i, depth, histogram[VC_CACHE_STATS_MAX + 1];
-    vc_entry *vc;
-
-    for (i = 0; i < VC_CACHE_STATS_MAX + 1; i++) {
-	histogram[i] = 0;
-    }
+    int i, histogram[VC_CACHE_STATS_MAX + 1];
+    Var p;
 
-    for (i = 0; i < vc_size; i++) {
-	depth = 0;
-	for (vc = vc_table[i]; vc; vc = vc->next)
-	    depth++;
-	if (depth > VC_CACHE_STATS_MAX)
-	    depth = VC_CACHE_STATS_MAX;
-	histogram[depth]++;
-    }
+    probe_histogram(&vc_callable, histogram);
 
     oklog("Verb cache stat summary: %d hits, %d misses, %d generations\n",
 	  verbcache_hit, verbcache_miss, db_verb_generation);
+    oklog("Command verb cache: %d hits, %d negative hits, %d misses\n",
+	  cmdcache_hit, cmdcache_neg_hit, cmdcache_miss);
+    oklog("%d entries discarded by invalidations, %d evicted\n",
+	  vc_discarded, vc_evicted);
+    p = db_property_cache_stats();
+    oklog("Property cache: %d hits, %d negative hits, %d misses\n",
+	  p.v.list[1].v.num, p.v.list[2].v.num, p.v.list[3].v.num);
+    free_var(p);
+    oklog("%d + %d entries in %d + %d slots\n",
+	  vc_callable.count, vc_command.count,
+	  vc_callable.slots ? vc_callable.mask + 1 : 0,
+	  vc_command.slots ? vc_command.mask + 1 : 0);
     oklog("Depth   Count\n");
     for (i = 0; i < VC_CACHE_STATS_MAX + 1; i++)
 	oklog("%-5d   %-5d\n", i, histogram[i]);
@@ -455,88 +811,133 @@ db_log_cache_stats(void)
 #endif
 
 db_verb_handle
-db_find_callable_verb(Objid oid, const char *verb)
+db_find_command_verb(Objid oid, const char *verb,
+		     db_arg_spec dobj, unsigned prep, db_arg_spec iobj)
 {
-    Object *o;
+    Objid a;
     Verbdef *v;
-#ifdef VERB_CACHE
-    vc_entry *new_vc;
-#else
     static handle h;
-#endif
     db_verb_handle vh;
+    int len;
+    unsigned vhash = str_hash(verb);
 
 #ifdef VERB_CACHE
-    unsigned int hash, bucket;
-    Objid first_parent_with_verbs = oid;
+    unsigned int hash;
+    int args = CC_ARGS(dobj, prep, iobj);
+    Objid first_parent_with_verbs;
     vc_entry *vc;
 
-    if (vc_table == NULL)
-	make_vc_table(DEFAULT_VC_SIZE);
+    first_parent_with_verbs = a = verb_ancestor(oid);
 
-    for (o = dbpriv_find_object(oid); o; o = dbpriv_find_object(o->parent)) {
-	if (o->verbdefs != NULL)
-	    break;
-    }
+    hash = vc_hash(vhash, first_parent_with_verbs, args);
 
-    if (o) {
-	first_parent_with_verbs = o->id;
-    } else {
-	first_parent_with_verbs = NOTHING;
+    if ((vc = vc_lookup(&vc_command, hash, first_parent_with_verbs, args,
+			verb)) != NULL) {
+	if (vc->h.verbdef) {
+	    cmdcache_hit++;
+	    h = vc->h;
+	    vh.ptr = &h;
+	} else {
+	    cmdcache_neg_hit++;
+	    vh.ptr = 0;
+	}
+	return vh;
     }
 
-    hash = str_hash(verb) ^ (~first_parent_with_verbs);		/* ewww, but who cares */
-    bucket = hash % vc_size;
+    cmdcache_miss++;
 
-    for (vc = vc_table[bucket]; vc; vc = vc->next) {
-	if (hash == vc->hash
-	    && first_parent_with_verbs == vc->oid_key
-	    && !mystrcasecmp(verb, vc->verbname)) {
-	    /* we haaave a winnaaah */
-	    if (vc->h.verbdef) {
-		verbcache_hit++;
-		vh.ptr = &vc->h;
-	    } else {
-		verbcache_neg_hit++;
-		vh.ptr = 0;
+    /* Negative caching, as in db_find_callable_verb_hashed() */
+    vc = vc_insert(&vc_command, hash, first_parent_with_verbs, args, verb);
+#else
+    a = verb_ancestor(oid);
+#endif
+
+    len = strlen(verb);
+    for ( /* from above */ ; a != NOTHING; a = verb_ancestor(obj_parent(a)))
+	for (v = dbpriv_find_object(a)->verbdefs; v; v = v->next) {
+	    db_arg_spec vdobj = (v->perms >> DOBJSHIFT) & OBJMASK;
+	    db_arg_spec viobj = (v->perms >> IOBJSHIFT) & OBJMASK;
+
+	    if (verb_name_matches(v, verb, len, vhash)
+		&& (vdobj == ASPEC_ANY || vdobj == dobj)
+		&& (v->prep == PREP_ANY || v->prep == prep)
+		&& (viobj == ASPEC_ANY || viobj == iobj)) {
+		h.definer = a;
+		h.verbdef = v;
+#ifdef VERB_CACHE
+		vc->h = h;
+#endif
+		vh.ptr = &h;
+		return vh;
 	    }
-	    return vh;
 	}
+
+    vh.ptr = 0;
+
+    return vh;
+}
+
+db_verb_handle
+db_find_callable_verb(Objid oid, const char *verb)
+{
+    return db_find_callable_verb_hashed(oid, verb, str_hash(verb));
+}
+
+db_verb_handle
+db_find_callable_verb_hashed(Objid oid, const char *verb, unsigned vhash)
+{
+    Objid a;
+    Verbdef *v;
+    static handle h;
+    db_verb_handle vh;
+    int vlen;
+
+#ifdef VERB_CACHE
+    unsigned int hash;
+    Objid first_parent_with_verbs;
+    vc_entry *vc;
+
+    first_parent_with_verbs = a = verb_ancestor(oid);
+
+    hash = vc_hash(vhash, first_parent_with_verbs, 0);
+
+    if ((vc = vc_lookup(&vc_callable, hash, first_parent_with_verbs, 0,
+			verb)) != NULL) {
+	/* we haaave a winnaaah */
+	if (vc->h.verbdef) {
+	    verbcache_hit++;
+	    h = vc->h;
+	    vh.ptr = &h;
+	} else {
+	    verbcache_neg_hit++;
+	    vh.ptr = 0;
+	}
+	return vh;
     }
 
     /* A swing and a miss. */
     verbcache_miss++;
-#else
-    o = dbpriv_find_object(oid);
-#endif
 
-#ifdef VERB_CACHE
     /*
      * Add the entry to the verbcache whether we find it or not.  This means
      * we do "negative caching", keeping track of failed lookups so that
      * repeated failures hit the cache instead of going through a lookup.
      */
-    new_vc = mymalloc(sizeof(vc_entry), M_VC_ENTRY);
-
-    new_vc->hash = hash;
-    new_vc->oid_key = first_parent_with_verbs;
-    new_vc->verbname = str_dup(verb);
-    new_vc->h.verbdef = NULL;
-    new_vc->next = vc_table[bucket];
-    vc_table[bucket] = new_vc;
+    vc = vc_insert(&vc_callable, hash, first_parent_with_verbs, 0, verb);
+#else
+    a = verb_ancestor(oid);
 #endif
 
-    for ( /* from above */ ; o; o = dbpriv_find_object(o->parent))
-	if ((v = find_verbdef_by_name(o, verb, 1)) != 0) {
-#ifdef VERB_CACHE
-	    new_vc->h.definer = o->id;
-	    new_vc->h.verbdef = v;
-	    vh.ptr = &new_vc->h;
-#else
-	    h.definer = o->id;
+    vlen = strlen(verb);
+    for ( /* from above */ ; a != NOTHING; a = verb_ancestor(obj_parent(a)))
+	if ((v = find_verbdef_by_name(dbpriv_find_object(a), verb, vlen,
+				      vhash, 1)) != 0) {
+	    h.definer = a;
 	    h.verbdef = v;
-	    vh.ptr = &h;
+#ifdef VERB_CACHE
+	    vc->h = h;
 #endif
+	    vh.ptr = &h;
 	    return vh;
 	}
     /*
@@ -557,6 +958,8 @@ db_find_defined_verb(Objid oid, const char *vname, int allow_numbers)
     int num, i;
     static handle h;
     db_verb_handle vh;
+    int len = strlen(vname);
+    unsigned hash = str_hash(vname);
 
     if (!allow_numbers ||
 	(num = strtol(vname, &p, 10),
@@ -564,7 +967,7 @@ db_find_defined_verb(Objid oid, const char *vname, int allow_numbers)
 	num = -1;
 
     for (i = 0, v = o->verbdefs; v; v = v->next, i++)
-	if (i == num || verbcasecmp(v->name, vname))
+	if (i == num || verb_name_matches(v, vname, len, hash))
 	    break;
 
     if (v) {
@@ -630,12 +1033,13 @@ db_set_verb_names(db_verb_handle vh, const char *names)
 {
     handle *h = (handle *) vh.ptr;
 
-    db_priv_affected_callable_verb_lookup();
-
     if (h) {
+	db_priv_affected_callable_verb_lookup(h->definer);
 	if (h->verbdef->name)
 	    free_str(h->verbdef->name);
-	h->verbdef->name = names;
+	h->verbdef->name = str_intern_name(names);
+	dbpriv_set_verb_matcher(h->verbdef);
+	free_str(names);
     } else
 	panic("DB_SET_VERB_NAMES: Null handle!");
 }
@@ -680,9 +1084,8 @@ db_set_verb_flags(db_verb_handle vh, unsigned flags)
 {
     handle *h = (handle *) vh.ptr;
 
-    db_priv_affected_callable_verb_lookup();
-
     if (h) {
+	db_priv_affected_callable_verb_lookup(h->definer);
 	h->verbdef->perms &= ~PERMMASK;
 	h->verbdef->perms |= flags;
     } else
@@ -740,9 +1143,8 @@ db_set_verb_arg_specs(db_verb_handle vh,
 {
     handle *h = (handle *) vh.ptr;
 
-    db_priv_affected_callable_verb_lookup();
-
     if (h) {
+	db_priv_affected_callable_verb_lookup(h->definer);
 	h->verbdef->perms = ((h->verbdef->perms & PERMMASK)
 			     | (dobj << DOBJSHIFT)
 			     | (iobj << IOBJSHIFT));
@@ -147,6 +147,29 @@ print_error_backtrace(const char *msg, void (*output) (const char *))
     free_stream(str);
 }
 
+/* Where is the running task?  Fills in the verb location, name and line of
+ * the top activation and returns 1, or returns 0 if no MOO code is running.
+ * The line is that of the last builtin or verb call the activation made
+ * (the interpreter only saves its pc at those points), which is the line
+ * responsible for anything allocated inside the call.
+ */
+int
+current_activation_site(Objid * vloc, const char **verbname, int *line)
+{
+    activation *a;
+
+    if (!interpreter_is_running)
+	return 0;
+    a = &activ_stack[top_activ_stack];
+    *vloc = a->vloc;
+    *verbname = a->verbname;
+    *line = find_line_number(a->prog,
+			     (top_activ_stack == 0 ? root_activ_vector
+			      : MAIN_VECTOR),
+			     a->error_pc);
+    return 1;
+}
+
 void
 output_to_log(const char *line)
 {
@@ -610,7 +633,7 @@ call_verb2(Objid this, const char *vname, Var args, int do_pass)
 
     if (!valid(where))
 	return E_INVIND;
-    h = db_find_callable_verb(where, vname);
+    h = db_find_callable_verb_hashed(where, vname, str_hash_memo(vname));
     if (!h.ptr)
 	return E_VERBNF;
     else if (!push_activation())
@@ -1035,8 +1058,15 @@ do {								\
 		    }
 		    PUSH(listset(res, value, index.v.num));
 		} else {	/* TYPE_STR */
-		    char *tmp_str = str_dup(list.v.str);
-		    free_str(list.v.str);
+		    char *tmp_str;
+
+		    if (var_refcount(list) == 1) {
+			tmp_str = (char *) list.v.str;
+			forget_strhash(tmp_str);
+		    } else {
+			tmp_str = str_dup(list.v.str);
+			free_str(list.v.str);
+		    }
 		    tmp_str[index.v.num - 1] = value.v.str[0];
 		    list.v.str = tmp_str;
 		    free_var(value);
@@ -1297,7 +1327,7 @@ do {								\
 		    ans.type = TYPE_INT;
 		    ans.v.num = -arg.v.num;
 		} else if (arg.type == TYPE_FLOAT)
-		    ans = new_float(-*arg.v.fnum);
+		    ans = new_float(-arg.v.fnum);
 		else {
 		    free_var(arg);
 		    PUSH_ERROR(E_TYPE);
@@ -1387,10 +1417,35 @@ do {								\
 			free_var(base);
 			PUSH_ERROR(E_RANGE);
 		    } else {
-			PUSH((base.type == TYPE_STR
-			      ? substr(base, from.v.num, to.v.num)
-			      : sublist(base, from.v.num, to.v.num)));
+			/* In `x = x[i..j]', x still refers to the base, so
+			 * substr() and sublist() would always copy.  When
+			 * that assignment is the very next thing done, x's
+			 * reference is handed over to them and x is given
+			 * the result here, an instruction early, instead.
+			 */
+			const Byte *next = bv;
+			Var *varp = 0, r;
+
+			if (IS_PUT_n(*next))
+			    varp = &RUN_ACTIV.rt_env[PUT_n_INDEX(*next)];
+			else if (*next++ == OP_G_PUT)
+			    varp = &RUN_ACTIV.rt_env[READ_BYTES(next,
+						 bc.numbytes_var_name)];
+			if (varp && var_refcount(base) == 2
+			    && varp->type == base.type
+			    && (base.type == TYPE_STR
+				? varp->v.str == base.v.str
+				: varp->v.list == base.v.list))
+			    free_var(*varp);
+			else
+			    varp = 0;
+			r = (base.type == TYPE_STR
+			     ? substr(base, from.v.num, to.v.num)
+			     : sublist(base, from.v.num, to.v.num));
 			/* base freed by substr/sublist */
+			if (varp)
+			    *varp = var_ref(r);
+			PUSH(r);
 			free_var(from);
 			free_var(to);
 		    }
@@ -1435,7 +1490,9 @@ do {								\
 		} else {
 		    db_prop_handle h;
 
-		    h = db_find_property(obj.v.obj, propname.v.str, &prop);
+		    h = db_find_property_hashed(obj.v.obj, propname.v.str,
+						str_hash_memo(propname.v.str),
+						&prop);
 		    free_var(propname);
 		    free_var(obj);
 		    if (!h.ptr)
@@ -1465,7 +1522,9 @@ do {								\
 		else {
 		    db_prop_handle h;
 
-		    h = db_find_property(obj.v.obj, propname.v.str, &prop);
+		    h = db_find_property_hashed(obj.v.obj, propname.v.str,
+						str_hash_memo(propname.v.str),
+						&prop);
 		    if (!h.ptr)
 			PUSH_ERROR(E_PROPNF);
 		    else if (h.built_in
@@ -1502,7 +1561,9 @@ do {								\
 		    enum error err = E_NONE;
 		    Objid progr = RUN_ACTIV.progr;
 
-		    h = db_find_property(obj.v.obj, propname.v.str, 0);
+		    h = db_find_property_hashed(obj.v.obj, propname.v.str,
+						str_hash_memo(propname.v.str),
+						0);
 		    if (!h.ptr)
 			err = E_PROPNF;
 		    else {
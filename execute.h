@@ -112,6 +112,8 @@ extern enum outcome resume_from_previous_vm(vm the_vm, Var value);
 extern int task_timed_out;
 extern void abort_running_task(void);
 extern void print_error_backtrace(const char *, void (*)(const char *));
+extern int current_activation_site(Objid * vloc, const char **verbname,
+				   int *line);
 extern void output_to_log(const char *);
 extern Objid caller();
 
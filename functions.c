@@ -20,6 +20,7 @@
 #include "bf_register.h"
 #include "config.h"
 #include "db_io.h"
+#include "db_tune.h"
 #include "functions.h"
 #include "list.h"
 #include "log.h"
@@ -203,12 +203,55 @@ listrangeset(Var base, int from, int to, Var value)
     return ans;
 }
 
+/* When substr() or sublist() is handed the only reference to its base, the
+ * range is carved out of the base's own storage instead of being copied:
+ * a dropped prefix is skipped over in place by myadvance() and a dropped
+ * tail is given back with myrealloc(), so that walking a value with
+ * `x = x[i..$]' costs nothing per step beyond freeing what's dropped (see
+ * OP_RANGE_REF in execute.c for how x's own reference is got out of the
+ * way).  The base is reused only while the range is at least
+ * 1/SUBRANGE_REUSE_FRACTION of its block, counting what earlier steps
+ * skipped over, so that a small result never holds on to a much larger
+ * block; past that point the range is copied, which happens seldom enough
+ * that a whole walk still copies less than the value's own size.
+ */
+#define SUBRANGE_REUSE_FRACTION 4
+
+static inline int
+reuse_subrange_base(Var base, const void *storage, Memory_Type type,
+		    unsigned size, unsigned newsize)
+{
+    return (var_refcount(base) == 1
+	    && newsize * SUBRANGE_REUSE_FRACTION >= size
+	    + myslack(storage, type));
+}
+
 Var
 sublist(Var list, int lower, int upper)
 {
     if (lower > upper) {
 	free_var(list);
 	return new_list(0);
+    } else if (reuse_subrange_base(list, list.v.list, M_LIST,
+				   (list.v.list[0].v.num + 1) * sizeof(Var),
+				   (upper - lower + 2) * sizeof(Var))) {
+	int i, len = list.v.list[0].v.num;
+	int newlen = upper - lower + 1;
+
+	for (i = 1; i < lower; i++)
+	    free_var(list.v.list[i]);
+	for (i = upper + 1; i <= len; i++)
+	    free_var(list.v.list[i]);
+	if (lower > 1) {
+	    list.v.list = myadvance(list.v.list, (lower - 1) * sizeof(Var),
+				    M_LIST);
+	    list.v.list[0].type = TYPE_INT;
+	}
+	list.v.list[0].v.num = newlen;
+	if (upper < len)
+	    list.v.list = myrealloc(list.v.list, (newlen + 1) * sizeof(Var),
+				    M_LIST);
+	return list;
     } else {
 	Var r;
 	int i;
@@ -238,7 +281,7 @@ stream_add_tostr(Stream * s, Var v)
 	stream_add_string(s, unparse_error(v.v.err));
 	break;
     case TYPE_FLOAT:
-	stream_printf(s, "%g", *v.v.fnum);
+	stream_printf(s, "%g", v.v.fnum);
 	break;
     case TYPE_LIST:
 	stream_add_string(s, "{list}");
@@ -279,7 +322,7 @@ unparse_value(Stream * s, Var v)
 	stream_add_string(s, error_name(v.v.err));
 	break;
     case TYPE_FLOAT:
-	stream_printf(s, "%g", *v.v.fnum);
+	stream_printf(s, "%g", v.v.fnum);
 	break;
     case TYPE_STR:
 	{
@@ -359,7 +402,24 @@ substr(Var str, int lower, int upper)
     r.type = TYPE_STR;
     if (lower > upper)
 	r.v.str = str_dup("");
-    else {
+    else if (lower == upper)
+	r.v.str = str_dup_char(str.v.str[lower - 1]);
+    else if (reuse_subrange_base(str, str.v.str, M_STRING,
+				 memo_strlen(str.v.str) + 1,
+				 upper - lower + 2)) {
+	char *s = (char *) str.v.str;
+	int len = memo_strlen(s);
+	int newlen = upper - lower + 1;
+
+	if (lower > 1)
+	    s = myadvance(s, lower - 1, M_STRING);
+	if (upper < len) {
+	    s[newlen] = '\0';
+	    s = myrealloc(s, newlen + 1, M_STRING);
+	}
+	r.v.str = s;
+	return r;
+    } else {
 	int loop, index = 0;
 	char *s = mymalloc(upper - lower + 2, M_STRING);
 
@@ -376,12 +436,9 @@ Var
 strget(Var str, Var i)
 {
     Var r;
-    char *s;
 
     r.type = TYPE_STR;
-    s = str_dup(" ");
-    s[0] = str.v.str[i.v.num - 1];
-    r.v.str = s;
+    r.v.str = str_dup_char(str.v.str[i.v.num - 1]);
     return r;
 }
 
@@ -28,20 +28,6 @@
 #include "unparse.h"
 #include "utils.h"
 
-static Var *
-aliases(Objid oid)
-{
-    Var value;
-    db_prop_handle h;
-
-    h = db_find_property(oid, "aliases", &value);
-    if (!h.ptr || value.type != TYPE_LIST) {
-	/* Simulate a pointer to an empty list */
-	return &zero;
-    } else
-	return value.v.list;
-}
-
 struct match_data {
     int lname;
     const char *name;
@@ -49,33 +35,37 @@ struct match_data {
 };
 
 static int
-match_proc(void *data, Objid oid)
+match_names(Objid where, struct match_data *d)
 {
-    struct match_data *d = data;
-    Var *names = aliases(oid);
-    int i;
-    const char *name;
+    int count;
+    const db_name_entry *names = db_contents_names(where, &count);
+    int lo = 0, hi = count;
 
-    for (i = 0; i <= names[0].v.num; i++) {
-	if (i == 0)
-	    name = db_object_name(oid);
-	else if (names[i].type != TYPE_STR)
-	    continue;
+    /* The names starting with d->name are together; find the first. */
+    while (lo < hi) {
+	int mid = (lo + hi) / 2;
+
+	if (mystrncasecmp(names[mid].name, d->name, d->lname) < 0)
+	    lo = mid + 1;
 	else
-	    name = names[i].v.str;
-
-	if (!mystrncasecmp(name, d->name, d->lname)) {
-	    if (name[d->lname] == '\0') {	/* exact match */
-		if (d->exact == NOTHING || d->exact == oid)
-		    d->exact = oid;
-		else
-		    return 1;
-	    } else {		/* partial match */
-		if (d->partial == FAILED_MATCH || d->partial == oid)
-		    d->partial = oid;
-		else
-		    d->partial = AMBIGUOUS;
-	    }
+	    hi = mid;
+    }
+
+    for (; lo < count && !mystrncasecmp(names[lo].name, d->name, d->lname);
+	 lo++) {
+	const char *name = names[lo].name;
+	Objid oid = names[lo].oid;
+
+	if (name[d->lname] == '\0') {	/* exact match */
+	    if (d->exact == NOTHING || d->exact == oid)
+		d->exact = oid;
+	    else
+		return 1;
+	} else {		/* partial match */
+	    if (d->partial == FAILED_MATCH || d->partial == oid)
+		d->partial = oid;
+	    else
+		d->partial = AMBIGUOUS;
 	}
     }
 
@@ -102,7 +92,7 @@ match_contents(Objid player, const char *name)
     for (oid = player, step = 0; step < 2; oid = loc, step++) {
 	if (!valid(oid))
 	    continue;
-	if (db_for_all_contents(oid, match_proc, &d))
+	if (match_names(oid, &d))
 	    /* We only abort the enumeration for exact ambiguous matches... */
 	    return AMBIGUOUS;
     }
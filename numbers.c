@@ -111,9 +111,9 @@ become_integer(Var in, int *ret, int called_from_tonum)
 	*ret = in.v.err;
 	break;
     case TYPE_FLOAT:
-	if (*in.v.fnum < (double) INT_MIN || *in.v.fnum > (double) INT_MAX)
+	if (in.v.fnum < (double) INT_MIN || in.v.fnum > (double) INT_MAX)
 	    return E_FLOAT;
-	*ret = (int) *in.v.fnum;
+	*ret = (int) in.v.fnum;
 	break;
     case TYPE_LIST:
 	return E_TYPE;
@@ -141,7 +141,7 @@ become_float(Var in, double *ret)
 	*ret = (double) in.v.err;
 	break;
     case TYPE_FLOAT:
-	*ret = *in.v.fnum;
+	*ret = in.v.fnum;
 	break;
     case TYPE_LIST:
 	return E_TYPE;
@@ -157,8 +157,7 @@ new_float(double d)
     Var v;
 
     v.type = TYPE_FLOAT;
-    v.v.fnum = mymalloc(sizeof(double), M_FLOAT);
-    *v.v.fnum = d;
+    v.v.fnum = d;
 
     return v;
 }
@@ -172,7 +171,7 @@ to_float(Var v, double *dp)
 	*dp = (double) v.v.num;
 	break;
     case TYPE_FLOAT:
-	*dp = *v.v.fnum;
+	*dp = v.v.fnum;
 	break;
     default:
 	return 0;
@@ -220,7 +219,7 @@ do_equals(Var lhs, Var rhs)
     if (lhs.type != rhs.type)
 	return 0;
     else
-	return *lhs.v.fnum == *rhs.v.fnum;
+	return lhs.v.fnum == rhs.v.fnum;
 }
 
 int
@@ -246,7 +245,7 @@ compare_numbers(Var a, Var b)
 	ans.type = TYPE_INT;
 	ans.v.num = compare_integers(a.v.num, b.v.num);
     } else {
-	double aa = *a.v.fnum, bb = *b.v.fnum;
+	double aa = a.v.fnum, bb = b.v.fnum;
 
 	ans.type = TYPE_INT;
 	if (aa < bb)
@@ -273,7 +272,7 @@ compare_numbers(Var a, Var b)
 			ans.type = TYPE_INT;			\
 			ans.v.num = a.v.num op b.v.num;		\
 		    } else {					\
-			double d = *a.v.fnum op *b.v.fnum;	\
+			double d = a.v.fnum op b.v.fnum;	\
 								\
 			if (!IS_REAL(d)) {			\
 			    ans.type = TYPE_ERR;		\
@@ -302,7 +301,7 @@ SIMPLE_BINARY(multiply, *)
 			ans.type = TYPE_INT;			\
 			ans.v.num = a.v.num iop b.v.num;	\
 		    } else if (a.type == TYPE_FLOAT		\
-			       && *b.v.fnum != 0.0) {		\
+			       && b.v.fnum != 0.0) {		\
 			double d = fexpr;			\
 								\
 			if (!IS_REAL(d)) {			\
@@ -318,8 +317,8 @@ SIMPLE_BINARY(multiply, *)
 		    return ans;					\
 		}
 
-DIVISION_OP(divide, /, *a.v.fnum / *b.v.fnum)
-DIVISION_OP(modulus, %, fmod(*a.v.fnum, *b.v.fnum))
+DIVISION_OP(divide, /, a.v.fnum / b.v.fnum)
+DIVISION_OP(modulus, %, fmod(a.v.fnum, b.v.fnum))
 Var
 do_power(Var lhs, Var rhs)
 {				/* LHS ^ RHS */
@@ -365,13 +364,13 @@ do_power(Var lhs, Var rhs)
 	    d = (double) rhs.v.num;
 	    break;
 	case TYPE_FLOAT:
-	    d = *rhs.v.fnum;
+	    d = rhs.v.fnum;
 	    break;
 	default:
 	    goto type_error;
 	}
 	errno = 0;
-	d = pow(*lhs.v.fnum, d);
+	d = pow(lhs.v.fnum, d);
 	if (errno != 0 || !IS_REAL(d)) {
 	    ans.type = TYPE_ERR;
 	    ans.v.err = E_FLOAT;
@@ -413,7 +412,7 @@ bf_tofloat(Var arglist, Byte next, void *vdata, Objid progr)
     enum error e;
 
     r = new_float(0.0);
-    e = become_float(arglist.v.list[1], r.v.fnum);
+    e = become_float(arglist.v.list[1], &r.v.fnum);
 
     free_var(arglist);
     if (e == E_NONE)
@@ -441,7 +440,7 @@ bf_min(Var arglist, Byte next, void *vdata, Objid progr)
 	for (i = 2; i <= nargs; i++)
 	    if (arglist.v.list[i].type != TYPE_FLOAT)
 		bad_types = 1;
-	    else if (*arglist.v.list[i].v.fnum < *r.v.fnum)
+	    else if (arglist.v.list[i].v.fnum < r.v.fnum)
 		r = arglist.v.list[i];
     }
 
@@ -471,7 +470,7 @@ bf_max(Var arglist, Byte next, void *vdata, Objid progr)
 	for (i = 2; i <= nargs; i++)
 	    if (arglist.v.list[i].type != TYPE_FLOAT)
 		bad_types = 1;
-	    else if (*arglist.v.list[i].v.fnum > *r.v.fnum)
+	    else if (arglist.v.list[i].v.fnum > r.v.fnum)
 		r = arglist.v.list[i];
     }
 
@@ -493,7 +492,7 @@ bf_abs(Var arglist, Byte next, void *vdata, Objid progr)
 	if (r.v.num < 0)
 	    r.v.num = -r.v.num;
     } else
-	*r.v.fnum = fabs(*r.v.fnum);
+	r.v.fnum = fabs(r.v.fnum);
 
     free_var(arglist);
     return make_var_pack(r);
@@ -505,7 +504,7 @@ bf_abs(Var arglist, Byte next, void *vdata, Objid progr)
 		{							      \
 		    double	d;					      \
 									      \
-		    d = *arglist.v.list[1].v.fnum;			      \
+		    d = arglist.v.list[1].v.fnum;			      \
 		    errno = 0;						      \
 		    d = name(d);					      \
 		    free_var(arglist);					      \
@@ -536,7 +535,7 @@ MATH_FUNC(floor)
 {
     double d;
 
-    d = *arglist.v.list[1].v.fnum;
+    d = arglist.v.list[1].v.fnum;
     errno = 0;
     if (d < 0.0)
 	d = ceil(d);
@@ -556,10 +555,10 @@ bf_atan(Var arglist, Byte next, void *vdata, Objid progr)
 {
     double d, dd;
 
-    d = *arglist.v.list[1].v.fnum;
+    d = arglist.v.list[1].v.fnum;
     errno = 0;
     if (arglist.v.list[0].v.num >= 2) {
-	dd = *arglist.v.list[2].v.fnum;
+	dd = arglist.v.list[2].v.fnum;
 	d = atan2(d, dd);
     } else
 	d = atan(d);
@@ -847,7 +846,7 @@ bf_random(Var arglist, Byte next, void *vdata, Objid progr)
 static package
 bf_floatstr(Var arglist, Byte next, void *vdata, Objid progr)
 {				/* (float, precision [, sci-notation]) */
-    double d = *arglist.v.list[1].v.fnum;
+    double d = arglist.v.list[1].v.fnum;
     int prec = arglist.v.list[2].v.num;
     int use_sci = (arglist.v.list[0].v.num >= 3
 		   && is_true(arglist.v.list[3]));
@@ -314,7 +314,6 @@ bf_chparent(Var arglist, Byte next, void *vdata, Objid progr)
 {				/* (object, new_parent) */
     Objid what = arglist.v.list[1].v.obj;
     Objid parent = arglist.v.list[2].v.obj;
-    Objid oid;
 
     free_var(arglist);
     if (!valid(what)
@@ -325,9 +324,8 @@ bf_chparent(Var arglist, Byte next, void *vdata, Objid progr)
 		 && !db_object_allows(parent, progr, FLAG_FERTILE)))
 	return make_error_pack(E_PERM);
     else {
-	for (oid = parent; oid != NOTHING; oid = db_object_parent(oid))
-	    if (oid == what)
-		return make_error_pack(E_RECMOVE);
+	if (valid(parent) && db_object_isa(parent, what))
+	    return make_error_pack(E_RECMOVE);
 
 	if (!db_change_parent(what, parent))
 	    return make_error_pack(E_INVARG);
@@ -377,19 +375,50 @@ bf_children(Var arglist, Byte next, void *vdata, Objid progr)
 
     free_var(arglist);
 
+    if (!valid(oid))
+	return make_error_pack(E_INVARG);
+    else
+	return make_var_pack(db_object_children(oid));
+}
+
+static package
+bf_isa(Var arglist, Byte next, void *vdata, Objid progr)
+{				/* (object, ancestor) */
+    Objid oid = arglist.v.list[1].v.obj;
+    Objid ancestor = arglist.v.list[2].v.obj;
+    Var r;
+
+    free_var(arglist);
+
+    if (!valid(oid))
+	return make_error_pack(E_INVARG);
+    else {
+	r.type = TYPE_INT;
+	r.v.num = valid(ancestor) && db_object_isa(oid, ancestor);
+	return make_var_pack(r);
+    }
+}
+
+static package
+bf_descendants(Var arglist, Byte next, void *vdata, Objid progr)
+{				/* (object) */
+    Objid oid = arglist.v.list[1].v.obj;
+
+    free_var(arglist);
+
     if (!valid(oid))
 	return make_error_pack(E_INVARG);
     else {
 	struct children_data d;
 
-	d.r = new_list(db_count_children(oid));
+	d.r = new_list(db_count_descendants(oid));
 	d.i = 0;
-	db_for_all_children(oid, add_to_list, &d);
+	db_for_all_descendants(oid, add_to_list, &d);
 
 	return make_var_pack(d.r);
     }
 }
-
+
 static int
 move_to_nothing(Objid oid)
 {
@@ -607,6 +636,8 @@ register_objects(void)
     register_function("valid", 1, 1, bf_valid, TYPE_OBJ);
     register_function("parent", 1, 1, bf_parent, TYPE_OBJ);
     register_function("children", 1, 1, bf_children, TYPE_OBJ);
+    register_function("isa", 2, 2, bf_isa, TYPE_OBJ, TYPE_OBJ);
+    register_function("descendants", 1, 1, bf_descendants, TYPE_OBJ);
     register_function("chparent", 2, 2, bf_chparent, TYPE_OBJ, TYPE_OBJ);
     register_function("max_object", 0, 0, bf_max_object);
     register_function("players", 0, 0, bf_players);
@@ -291,6 +291,40 @@
  */
 /* #define MEMO_STRLEN */
 
+/******************************************************************************
+ * Store the str_hash() of a string WITH the string, computed the first time
+ * it is needed, rather than rehashing it on every property lookup or verb
+ * cache probe.  Costs one more word per string.
+ ******************************************************************************
+ */
+/* #define MEMO_STRHASH */
+
+/******************************************************************************
+ * Define USE_SLAB_ALLOCATOR to have small list and string allocations (up to
+ * 256 bytes, counting the reference count) carved out of 64K pages of
+ * same-sized blocks, with per-size free lists, rather than each going to
+ * malloc() on its own.  Pages that empty out are returned to malloc().  With
+ * this enabled, memory_usage() reports {block-size, nused, nfree} for each
+ * size class.  Needs posix_memalign().
+ ******************************************************************************
+ */
+/* #define USE_SLAB_ALLOCATOR */
+
+/******************************************************************************
+ * Lists too big to free in one go are normally queued and freed a slice at a
+ * time by the main loop.  Define USE_RECLAIMER_THREAD to have a separate
+ * thread tear them down instead: it frees whatever only the dead list refers
+ * to and hands anything still shared back to the main loop, which alone may
+ * touch reference counts.  RECLAIM_QUEUE_BYTES bounds how much list storage
+ * may be waiting on the thread; past that, the main loop does the work.
+ * Needs POSIX threads (`configure' looks for pthread_create() and the
+ * library it lives in); not compatible with USE_SLAB_ALLOCATOR or
+ * USE_GNU_MALLOC.
+ ******************************************************************************
+ */
+/* #define USE_RECLAIMER_THREAD */
+#define RECLAIM_QUEUE_BYTES	(256 * 1024 * 1024)
+
 /******************************************************************************
  * This package comes with a copy of the implementation of malloc() from GNU
  * Emacs.  This is a very nice and reasonably portable implementation, but some
@@ -342,6 +376,17 @@
 #define MIN_LIST_CONCAT_LIMIT   1022
 #define MIN_STRING_CONCAT_LIMIT 1015
 
+/******************************************************************************
+ * DEFAULT_MAX_VERB_CACHE_BYTES bounds the memory used by the tables caching
+ * verb lookups; once they reach it, new lookups evict old ones rather than
+ * growing the tables.  $server_options.max_verb_cache_bytes, if defined,
+ * overrides it, but is silently raised to at least MIN_VERB_CACHE_BYTES.
+ ******************************************************************************
+ */
+
+#define DEFAULT_MAX_VERB_CACHE_BYTES 16777216
+#define MIN_VERB_CACHE_BYTES           131072
+
 
 /*****************************************************************************
  ********** You shouldn't need to change anything below this point. **********
@@ -360,6 +405,17 @@
 #if DEFAULT_MAX_STRING_CONCAT < MIN_STRING_CONCAT_LIMIT
 #error DEFAULT_MAX_STRING_CONCAT < MIN_STRING_CONCAT_LIMIT ??
 #endif
+#if DEFAULT_MAX_VERB_CACHE_BYTES < MIN_VERB_CACHE_BYTES
+#error DEFAULT_MAX_VERB_CACHE_BYTES < MIN_VERB_CACHE_BYTES ??
+#endif
+
+#if defined(USE_SLAB_ALLOCATOR) && defined(USE_GNU_MALLOC)
+#error USE_SLAB_ALLOCATOR and USE_GNU_MALLOC cannot both be defined
+#endif
+#if defined(USE_RECLAIMER_THREAD) \
+    && (defined(USE_SLAB_ALLOCATOR) || defined(USE_GNU_MALLOC))
+#error USE_RECLAIMER_THREAD needs the system malloc()
+#endif
 
 #if PATTERN_CACHE_SIZE < 1
 #  error Illegal match() pattern cache size!
@@ -410,6 +466,10 @@
 #  endif
 #endif
 
+#if defined(USE_RECLAIMER_THREAD) && !HAVE_PTHREAD_CREATE
+#  error USE_RECLAIMER_THREAD needs POSIX threads, and configure found none!
+#endif
+
 #if (NETWORK_PROTOCOL == NP_LOCAL || NETWORK_PROTOCOL == NP_SINGLE) && defined(OUTBOUND_NETWORK)
 #  error You cannot define "OUTBOUND_NETWORK" with that "NETWORK_PROTOCOL"
 #endif
@@ -27,6 +27,7 @@
 #include "match.h"
 #include "parse_cmd.h"
 #include "storage.h"
+#include "str_intern.h"
 #include "structures.h"
 #include "utils.h"
 
@@ -78,6 +79,15 @@ parse_into_words(char *input, int *nwords)
     return words;
 }
 
+/* A copy of the command word W; one-character words are shared. */
+static const char *
+word_dup(const char *w)
+{
+    if (w[0] != '\0' && w[1] == '\0')
+	return str_dup_char(w[0]);
+    return str_dup(w);
+}
+
 static char *
 build_string(int argc, char *argv[])
 {
@@ -117,7 +127,7 @@ parse_into_wordlist(const char *command)
     args = new_list(argc);
     for (i = 1; i <= argc; i++) {
 	args.v.list[i].type = TYPE_STR;
-	args.v.list[i].v.str = str_dup(argv[i - 1]);
+	args.v.list[i].v.str = word_dup(argv[i - 1]);
     }
     free_str(s);
     return args;
@@ -182,13 +192,13 @@ parse_command(const char *command, Objid user)
 	free_str(buf);
 	return 0;
     }
-    pc.verb = str_dup(argv[0]);
+    pc.verb = str_intern_name(argv[0]);	/* as the verb cache keeps it */
     pc.argstr = str_dup(argstr);
 
     pc.args = new_list(argc - 1);
     for (i = 1; i < argc; i++) {
 	pc.args.v.list[i].type = TYPE_STR;
-	pc.args.v.list[i].v.str = str_dup(argv[i]);
+	pc.args.v.list[i].v.str = word_dup(argv[i]);
     }
 
     /*
@@ -214,7 +224,8 @@ parse_command(const char *command, Objid user)
      * find the iobj & dobj around it, if any
      */
     if (pc.prep != PREP_NONE) {
-	pc.prepstr = build_string(pend - pstart + 1, argv + pstart);
+	pc.prepstr = (pend == pstart ? str_intern_name(argv[pstart])
+		      : build_string(pend - pstart + 1, argv + pstart));
 	pc.iobjstr = build_string(argc - (pend + 1), argv + (pend + 1));
 	pc.iobj = match_object(user, pc.iobjstr);
     } else {
@@ -71,7 +71,7 @@ static void	check_loop_name(const char *, enum loop_exit_kind);
   Expr	       *expr;
   int		integer;
   Objid		object;
-  double       *real;
+  double	real;
   char	       *string;
   enum error	error;
   Arg_List     *args;
@@ -546,7 +546,7 @@ expr:
 			    $2->e.var.v.num = -$2->e.var.v.num;
 			    break;
 			  case TYPE_FLOAT:
-			    *($2->e.var.v.fnum) = - (*($2->e.var.v.fnum));
+			    $2->e.var.v.fnum = - $2->e.var.v.fnum;
 			    break;
 			  default:
 			    break;
@@ -890,7 +890,7 @@ start_over:
 		yyerror("Floating-point literal out of range");
 		d = 0.0;
 	    }
-	    yylval.real = alloc_float(d);
+	    yylval.real = d;
 	}
 	return type;
     }
@@ -21,9 +21,15 @@
 extern void addref(const void *p);
 extern unsigned int delref(const void *p);
 #else
-#define addref(X) (++((int *)(X))[-1])
-#define delref(X) (--((int *)(X))[-1])
-#define refcount(X) (((int *)(X))[-1])
+/* The count is kept in the int just below the value's storage.  A string
+ * that has had a prefix dropped in place (see myadvance() in storage.c)
+ * may start at any byte, so the header is found below the start rounded
+ * down to an int boundary; for everything else, that's the start itself.
+ */
+#define ref_header(X) ((int *) ((unsigned long) (X) & ~(sizeof(int) - 1)))
+#define addref(X) (++ref_header(X)[-1])
+#define delref(X) (--ref_header(X)[-1])
+#define refcount(X) (ref_header(X)[-1])
 #endif
 
 /* 
@@ -446,6 +446,10 @@ main_loop(void)
 	int seconds_left = task_seconds < 0 ? 2 : task_seconds;
 	shandle *h, *nexth;
 
+	/* Don't sit waiting for input while there are values left to free. */
+	if (free_deferred_values())
+	    seconds_left = 0;
+
 	if (checkpoint_requested != CHKPT_OFF) {
 	    if (checkpoint_requested == CHKPT_SIGNAL)
 		oklog("CHECKPOINTING due to remote request signal.\n");
@@ -453,6 +457,7 @@ main_loop(void)
 	    run_server_task(-1, SYSTEM_OBJECT, "checkpoint_started",
 			    new_list(0), "", 0);
 	    network_process_io(0);
+	    log_memory_type_usage();
 #ifdef UNFORKED_CHECKPOINTS
 	    call_checkpoint_notifier(db_flush(FLUSH_ALL_NOW));
 #else
@@ -1187,8 +1192,9 @@ main(int argc, char **argv)
     char *this_program = str_dup(argv[0]);
     const char *log_file = 0;
     int emergency = 0;
+    int convert = 0;
     Var desc;
-    slistener *l;
+    slistener *l = 0;
 
     init_cmdline(argc, argv);
 
@@ -1200,6 +1206,16 @@ main(int argc, char **argv)
 	case 'e':		/* Emergency wizard mode */
 	    emergency = 1;
 	    break;
+	case 'c':		/* Convert the DB and exit */
+	    convert = 1;
+	    break;
+	case 'f':		/* Specified DB dump format */
+	    if (argc > 1 && db_set_dump_format(argv[1])) {
+		argc--;
+		argv++;
+	    } else
+		argc = 0;	/* Provoke usage message below */
+	    break;
 	case 'l':		/* Specified log file */
 	    if (argc > 1) {
 		log_file = argv[1];
@@ -1229,7 +1245,8 @@ main(int argc, char **argv)
 
     if (!db_initialize(&argc, &argv)
 	|| !network_initialize(argc, argv, &desc)) {
-	fprintf(stderr, "Usage: %s [-e] [-l log-file] %s %s\n",
+	fprintf(stderr,
+		"Usage: %s [-e] [-c] [-f text|binary] [-l log-file] %s %s\n",
 		this_program, db_usage_string(), network_usage_string());
 	exit(1);
     }
@@ -1247,16 +1264,23 @@ main(int argc, char **argv)
 
     register_bi_functions();
 
-    l = new_slistener(SYSTEM_OBJECT, desc, 1, 0);
-    if (!l) {
-	errlog("Can't create initial connection point!\n");
-	exit(1);
+    if (!convert) {
+	l = new_slistener(SYSTEM_OBJECT, desc, 1, 0);
+	if (!l) {
+	    errlog("Can't create initial connection point!\n");
+	    exit(1);
+	}
     }
     free_var(desc);
 
     if (!db_load())
 	exit(1);
 
+    if (convert) {		/* just dump it again, in the chosen format */
+	db_shutdown();
+	return 0;
+    }
+
     load_server_options();
 
     SRANDOM(time(0));
@@ -1337,6 +1361,56 @@ bf_memory_usage(Var arglist, Byte next, void *vdata, Objid progr)
     return make_var_pack(r);
 }
 
+static package
+bf_memory_type_usage(Var arglist, Byte next, void *vdata, Objid progr)
+{
+    free_var(arglist);
+    if (!is_wizard(progr))
+	return make_error_pack(E_PERM);
+
+    return make_var_pack(memory_type_usage());
+}
+
+#define DEFAULT_ALLOC_SAMPLE_INTERVAL	(512 * 1024)
+
+static package
+bf_start_alloc_profile(Var arglist, Byte next, void *vdata, Objid progr)
+{				/* ([interval]) */
+    int interval = (arglist.v.list[0].v.num > 0
+		    ? arglist.v.list[1].v.num
+		    : DEFAULT_ALLOC_SAMPLE_INTERVAL);
+
+    free_var(arglist);
+    if (!is_wizard(progr))
+	return make_error_pack(E_PERM);
+    if (interval <= 0)
+	return make_error_pack(E_INVARG);
+
+    start_alloc_profile(interval);
+    return no_var_pack();
+}
+
+static package
+bf_stop_alloc_profile(Var arglist, Byte next, void *vdata, Objid progr)
+{
+    free_var(arglist);
+    if (!is_wizard(progr))
+	return make_error_pack(E_PERM);
+
+    stop_alloc_profile();
+    return no_var_pack();
+}
+
+static package
+bf_alloc_profile(Var arglist, Byte next, void *vdata, Objid progr)
+{
+    free_var(arglist);
+    if (!is_wizard(progr))
+	return make_error_pack(E_PERM);
+
+    return make_var_pack(alloc_profile());
+}
+
 static package
 bf_shutdown(Var arglist, Byte next, void *vdata, Objid progr)
 {
@@ -1777,6 +1851,11 @@ register_server(void)
     register_function("renumber", 1, 1, bf_renumber, TYPE_OBJ);
     register_function("reset_max_object", 0, 0, bf_reset_max_object);
     register_function("memory_usage", 0, 0, bf_memory_usage);
+    register_function("memory_type_usage", 0, 0, bf_memory_type_usage);
+    register_function("start_alloc_profile", 0, 1, bf_start_alloc_profile,
+		      TYPE_INT);
+    register_function("stop_alloc_profile", 0, 0, bf_stop_alloc_profile);
+    register_function("alloc_profile", 0, 0, bf_alloc_profile);
     register_function("shutdown", 0, 1, bf_shutdown, TYPE_STR);
     register_function("dump_database", 0, 0, bf_dump_database);
     register_function("db_disk_size", 0, 0, bf_db_disk_size);
@@ -190,7 +190,16 @@ extern int get_server_option(Objid oid, const char *name, Var * r);
 								\
   DEFINE( SVO_MAX_CONCAT_CATCHABLE, max_concat_catchable,	\
 	  flag, 0, /* already canonical */			\
-	  )
+	  )							\
+								\
+  DEFINE( SVO_MAX_VERB_CACHE_BYTES, max_verb_cache_bytes,	\
+								\
+	  int, DEFAULT_MAX_VERB_CACHE_BYTES,			\
+	 _STATEMENT({						\
+	     if (value < MIN_VERB_CACHE_BYTES)			\
+		 value = MIN_VERB_CACHE_BYTES;			\
+	     db_set_verb_cache_limit(value);			\
+	   }))
 
 /* List of all category (2) and (3) cached server options */
 enum Server_Option {
@@ -17,20 +17,143 @@
 
 #include "my-stdlib.h"
 
+#include "my-time.h"
+
 #include "config.h"
 #include "exceptions.h"
+#include "execute.h"
 #include "list.h"
+#include "log.h"
 #include "options.h"
 #include "ref_count.h"
 #include "storage.h"
 #include "structures.h"
 #include "utils.h"
 
-static unsigned alloc_num[Sizeof_Memory_Type];
-#ifdef USE_GNU_MALLOC
-static unsigned alloc_size[Sizeof_Memory_Type], alloc_real_size[Sizeof_Memory_Type];
+/* How many bytes does malloc() really hold for a block?  Where the
+ * allocator can't tell us, keep the size in a header in front of the block.
+ */
+#if defined(USE_GNU_MALLOC)
+extern unsigned malloc_real_size(void *ptr);
+#define malloc_block_size(P)	malloc_real_size(P)
+#elif defined(__GLIBC__)
+#include <malloc.h>
+#define malloc_block_size(P)	malloc_usable_size(P)
+#elif defined(__APPLE__)
+#include <malloc/malloc.h>
+#define malloc_block_size(P)	malloc_size(P)
 #endif
 
+#ifdef malloc_block_size
+
+#define heap_alloc(N)		malloc(N)
+#define heap_realloc(P, N)	realloc(P, N)
+#define heap_free(P)		free(P)
+#define heap_size(P)		malloc_block_size(P)
+
+#else				/* !malloc_block_size */
+
+union size_header {
+    size_t size;
+    double d;			/* for alignment */
+    void *p;
+};
+
+static inline void *
+heap_alloc(size_t n)
+{
+    union size_header *h = malloc(sizeof(union size_header) + n);
+
+    if (!h)
+	return 0;
+    h->size = sizeof(union size_header) + n;
+    return h + 1;
+}
+
+static inline void *
+heap_realloc(void *p, size_t n)
+{
+    union size_header *h = realloc((union size_header *) p - 1,
+				   sizeof(union size_header) + n);
+
+    if (!h)
+	return 0;
+    h->size = sizeof(union size_header) + n;
+    return h + 1;
+}
+
+#define heap_free(P)		free((union size_header *) (P) - 1)
+#define heap_size(P)		(((union size_header *) (P))[-1].size)
+
+#endif				/* !malloc_block_size */
+
+/* Live block count, live bytes and high-water mark of bytes, for each
+ * Memory_Type.  Bytes are what the allocator actually holds, refcount
+ * prefixes and rounding included.
+ */
+static struct alloc_stats {
+    unsigned count;
+    size_t bytes, peak;
+} alloc_stats[Sizeof_Memory_Type];
+
+static const char *memory_type_names[Sizeof_Memory_Type] = {
+    [M_AST_POOL] = "ast_pool",
+    [M_AST] = "ast",
+    [M_PROGRAM] = "program",
+    [M_PVAL] = "pval",
+    [M_NETWORK] = "network",
+    [M_STRING] = "string",
+    [M_VERBDEF] = "verbdef",
+    [M_LIST] = "list",
+    [M_PREP] = "prep",
+    [M_PROPDEF] = "propdef",
+    [M_OBJECT_TABLE] = "object_table",
+    [M_OBJECT] = "object",
+    [M_STREAM] = "stream",
+    [M_NAMES] = "names",
+    [M_ENV] = "env",
+    [M_TASK] = "task",
+    [M_PATTERN] = "pattern",
+    [M_BYTECODES] = "bytecodes",
+    [M_FORK_VECTORS] = "fork_vectors",
+    [M_LIT_LIST] = "lit_list",
+    [M_PROTOTYPE] = "prototype",
+    [M_CODE_GEN] = "code_gen",
+    [M_DISASSEMBLE] = "disassemble",
+    [M_DECOMPILE] = "decompile",
+    [M_RT_STACK] = "rt_stack",
+    [M_RT_ENV] = "rt_env",
+    [M_BI_FUNC_DATA] = "bi_func_data",
+    [M_VM] = "vm",
+    [M_REF_ENTRY] = "ref_entry",
+    [M_REF_TABLE] = "ref_table",
+    [M_VC_ENTRY] = "vc_entry",
+    [M_VC_TABLE] = "vc_table",
+    [M_STRING_PTRS] = "string_ptrs",
+    [M_INTERN_POINTER] = "intern_pointer",
+    [M_INTERN_ENTRY] = "intern_entry",
+    [M_INTERN_HUNK] = "intern_hunk",
+    [M_PROP_INDEX] = "prop_index",
+    [M_VERB_MATCHER] = "verb_matcher",
+    [M_NAME_INDEX] = "name_index",
+};
+
+static inline void
+charge(Memory_Type type, size_t bytes)
+{
+    struct alloc_stats *a = &alloc_stats[type];
+
+    a->bytes += bytes;
+    if (a->bytes > a->peak)
+	a->peak = a->bytes;
+}
+
+static inline void
+discharge(Memory_Type type, size_t bytes)
+{
+    alloc_stats[type].bytes -= bytes;
+}
+
 static inline int
 refcount_overhead(Memory_Type type)
 {
@@ -39,23 +162,528 @@ refcount_overhead(Memory_Type type)
      * refcount slot for allocations that won't need it.
      */
     switch (type) {
-    case M_FLOAT:
-	/* for systems with picky double alignment */
-	return MAX(sizeof(int), sizeof(double));
     case M_STRING:
+	return sizeof(int) + sizeof(int)	/* refcount, block_front() */
 #ifdef MEMO_STRLEN
-	return sizeof(int) + sizeof(int);
-#else
-	return sizeof(int);
+	    + sizeof(int)
 #endif /* MEMO_STRLEN */
+#ifdef MEMO_STRHASH
+	    + sizeof(unsigned)
+#endif /* MEMO_STRHASH */
+	    ;
     case M_LIST:
 	/* for systems with picky pointer alignment */
-	return MAX(sizeof(int), sizeof(Var *));
+	return MAX(2 * sizeof(int), sizeof(Var *));
     default:
 	return 0;
     }
 }
 
+/* The start of the block holding ptr. */
+static inline char *
+block_of(const void *ptr, Memory_Type type)
+{
+    int offs = refcount_overhead(type);
+
+    if (!offs)
+	return (char *) ptr;
+    return (char *) ref_header(ptr) - offs - block_front(ptr, type);
+}
+
+#ifdef USE_SLAB_ALLOCATOR
+
+/* The slab allocator.
+ *
+ * Lists and strings are the bulk of what the interpreter allocates, and
+ * nearly all of them are small and short-lived.  Blocks of up to
+ * SLAB_MAX_BLOCK bytes (counting the refcount prefix) of those types are
+ * carved out of SLAB_PAGE_SIZE pages, one size class per page; each page
+ * keeps its own free list plus a never-used tail, and each class keeps a
+ * list of its pages that have room.  A page that empties completely is
+ * handed back to malloc() unless it is the only page its class has room
+ * in.  Everything else goes straight to malloc() as before.
+ *
+ * Pages are aligned on their size, so the page holding a block is found
+ * by masking its address; a small open-addressed set of page addresses
+ * tells myfree() and myrealloc() whether a block came from a page at all.
+ */
+
+#define SLAB_PAGE_SHIFT		16
+#define SLAB_PAGE_SIZE		(1 << SLAB_PAGE_SHIFT)
+#define SLAB_GRAIN		16
+#define SLAB_CLASSES		16
+#define SLAB_MAX_BLOCK		(SLAB_GRAIN * SLAB_CLASSES)
+
+#define SLAB_BLOCK_SIZE(cls)	(((cls) + 1) * SLAB_GRAIN)
+#define SLAB_HEADER_SIZE	((sizeof(struct slab_page) + SLAB_GRAIN - 1) \
+				 / SLAB_GRAIN * SLAB_GRAIN)
+
+struct slab_block {
+    struct slab_block *next;
+};
+
+struct slab_page {
+    struct slab_page *next, *prev;	/* pages of this class with room */
+    struct slab_block *free;
+    char *fresh;		/* start of the never-used tail */
+    int cls;
+    int nfree;			/* blocks on free list + blocks in tail */
+    int nblocks;
+};
+
+static struct slab_class {
+    struct slab_page *pages;	/* those with room */
+    unsigned nused, nfree, npages;
+} slab_classes[SLAB_CLASSES];
+
+static unsigned long *slab_page_set = 0;
+static unsigned slab_page_set_mask = 0;
+static unsigned slab_page_count = 0;
+
+#define SLAB_PAGE_HASH(key)	((unsigned) ((key) * 2654435761UL))
+
+static inline int
+slab_class_of(unsigned total, Memory_Type type)
+{
+    if ((type != M_STRING && type != M_LIST) || total > SLAB_MAX_BLOCK)
+	return -1;
+    return (total - 1) / SLAB_GRAIN;
+}
+
+static inline struct slab_page *
+slab_page_of(void *base)
+{
+    unsigned long key = (unsigned long) base >> SLAB_PAGE_SHIFT;
+    unsigned i;
+
+    if (!slab_page_set)
+	return 0;
+    for (i = SLAB_PAGE_HASH(key) & slab_page_set_mask;
+	 slab_page_set[i];
+	 i = (i + 1) & slab_page_set_mask)
+	if (slab_page_set[i] == key)
+	    return (struct slab_page *) (key << SLAB_PAGE_SHIFT);
+    return 0;
+}
+
+static void
+slab_set_insert(unsigned long *set, unsigned mask, unsigned long key)
+{
+    unsigned i;
+
+    for (i = SLAB_PAGE_HASH(key) & mask; set[i]; i = (i + 1) & mask)
+	;
+    set[i] = key;
+}
+
+static void
+slab_set_add(struct slab_page *p)
+{
+    unsigned long key = (unsigned long) p >> SLAB_PAGE_SHIFT;
+
+    if (2 * (slab_page_count + 1) > slab_page_set_mask + 1 || !slab_page_set) {
+	unsigned new_mask = slab_page_set ? 2 * slab_page_set_mask + 1 : 255;
+	unsigned long *new_set = calloc(new_mask + 1, sizeof(unsigned long));
+	unsigned i;
+
+	if (!new_set)
+	    panic("slab page table allocation failed!");
+	if (slab_page_set) {
+	    for (i = 0; i <= slab_page_set_mask; i++)
+		if (slab_page_set[i])
+		    slab_set_insert(new_set, new_mask, slab_page_set[i]);
+	    free(slab_page_set);
+	}
+	slab_page_set = new_set;
+	slab_page_set_mask = new_mask;
+    }
+    slab_set_insert(slab_page_set, slab_page_set_mask, key);
+    slab_page_count++;
+}
+
+static void
+slab_set_remove(struct slab_page *p)
+{
+    unsigned long key = (unsigned long) p >> SLAB_PAGE_SHIFT;
+    unsigned mask = slab_page_set_mask;
+    unsigned i, j, home;
+
+    for (i = SLAB_PAGE_HASH(key) & mask; slab_page_set[i] != key;
+	 i = (i + 1) & mask)
+	;
+    /* Shift later members of the probe sequence back over the hole. */
+    for (j = (i + 1) & mask; slab_page_set[j]; j = (j + 1) & mask) {
+	home = SLAB_PAGE_HASH(slab_page_set[j]) & mask;
+	if (((j - home) & mask) >= ((j - i) & mask)) {
+	    slab_page_set[i] = slab_page_set[j];
+	    i = j;
+	}
+    }
+    slab_page_set[i] = 0;
+    slab_page_count--;
+}
+
+static inline void
+slab_unlink(struct slab_class *c, struct slab_page *p)
+{
+    if (p->prev)
+	p->prev->next = p->next;
+    else
+	c->pages = p->next;
+    if (p->next)
+	p->next->prev = p->prev;
+    p->next = p->prev = 0;
+}
+
+static struct slab_page *
+slab_new_page(int cls)
+{
+    struct slab_class *c = &slab_classes[cls];
+    struct slab_page *p;
+    void *mem;
+
+    if (posix_memalign(&mem, SLAB_PAGE_SIZE, SLAB_PAGE_SIZE) != 0)
+	return 0;
+    p = mem;
+    p->cls = cls;
+    p->free = 0;
+    p->fresh = (char *) p + SLAB_HEADER_SIZE;
+    p->nblocks = p->nfree
+	= (SLAB_PAGE_SIZE - SLAB_HEADER_SIZE) / SLAB_BLOCK_SIZE(cls);
+    p->prev = 0;
+    p->next = c->pages;
+    if (c->pages)
+	c->pages->prev = p;
+    c->pages = p;
+    c->npages++;
+    c->nfree += p->nblocks;
+    slab_set_add(p);
+    return p;
+}
+
+static inline void *
+slab_alloc(int cls)
+{
+    struct slab_class *c = &slab_classes[cls];
+    struct slab_page *p = c->pages;
+    struct slab_block *b;
+
+    if (!p && !(p = slab_new_page(cls)))
+	return 0;
+    if ((b = p->free))
+	p->free = b->next;
+    else {
+	b = (struct slab_block *) p->fresh;
+	p->fresh += SLAB_BLOCK_SIZE(cls);
+    }
+    if (--p->nfree == 0)
+	slab_unlink(c, p);
+    c->nused++;
+    c->nfree--;
+    return b;
+}
+
+static inline void
+slab_free(struct slab_page *p, void *base)
+{
+    struct slab_class *c = &slab_classes[p->cls];
+    struct slab_block *b = base;
+
+    b->next = p->free;
+    p->free = b;
+    c->nused--;
+    c->nfree++;
+    if (p->nfree++ == 0) {
+	p->prev = 0;
+	p->next = c->pages;
+	if (c->pages)
+	    c->pages->prev = p;
+	c->pages = p;
+    } else if (p->nfree == p->nblocks && (p->next || p->prev)) {
+	slab_unlink(c, p);
+	slab_set_remove(p);
+	c->npages--;
+	c->nfree -= p->nblocks;
+	free(p);
+    }
+}
+
+#endif				/* USE_SLAB_ALLOCATOR */
+
+/* The allocation profiler.
+ *
+ * While it is on, one allocation in roughly every alloc_sample_interval
+ * bytes is sampled: it is charged to the verb running at the time (see
+ * current_activation_site()) and remembered by address, so that freeing it
+ * takes it back off that verb's live total.  A sample stands for the
+ * larger of its own size and the interval.  The gaps between samples are
+ * randomized so that regular allocation patterns can't hide.  The
+ * profiler's tables come straight from malloc(), so it doesn't see itself.
+ */
+
+struct alloc_site {
+    Objid vloc;
+    char *verbname;
+    int line;
+    Memory_Type type;
+    size_t live, total;
+    struct alloc_site *next;
+};
+
+struct alloc_sample {
+    const void *ptr;
+    struct alloc_site *site;
+    size_t weight;
+    struct alloc_sample *next;
+};
+
+#define ALLOC_SITE_BUCKETS	1021
+
+static unsigned alloc_sample_interval = 0;	/* 0 == not profiling */
+static long alloc_sample_countdown;
+static int alloc_sampling = 0;		/* guards against recursion */
+static time_t alloc_profile_started;
+static unsigned alloc_sample_seed = 1;
+
+static struct alloc_site *alloc_sites[ALLOC_SITE_BUCKETS];
+static struct alloc_sample **alloc_samples = 0;
+static unsigned alloc_sample_buckets = 0, alloc_sample_count = 0;
+
+#define ALLOC_SAMPLE_HASH(p)	((unsigned) ((unsigned long) (p) >> 4))
+
+static long
+next_sample_gap(void)
+{
+    /* xorshift; anything roughly uniform on [1, 2 * interval] will do */
+    alloc_sample_seed ^= alloc_sample_seed << 13;
+    alloc_sample_seed ^= alloc_sample_seed >> 17;
+    alloc_sample_seed ^= alloc_sample_seed << 5;
+    return 1 + alloc_sample_seed % (2 * (unsigned long) alloc_sample_interval);
+}
+
+static struct alloc_site *
+find_alloc_site(Objid vloc, const char *verbname, int line, Memory_Type type)
+{
+    unsigned h = (str_hash(verbname) ^ ((vloc * 31 + line) * 31 + type))
+	% ALLOC_SITE_BUCKETS;
+    struct alloc_site *s;
+
+    for (s = alloc_sites[h]; s; s = s->next)
+	if (s->vloc == vloc && s->line == line && s->type == type
+	    && !strcmp(s->verbname, verbname))
+	    return s;
+    if (!(s = malloc(sizeof(struct alloc_site)))
+	|| !(s->verbname = malloc(strlen(verbname) + 1))) {
+	free(s);
+	return 0;
+    }
+    strcpy(s->verbname, verbname);
+    s->vloc = vloc;
+    s->line = line;
+    s->type = type;
+    s->live = s->total = 0;
+    s->next = alloc_sites[h];
+    alloc_sites[h] = s;
+    return s;
+}
+
+static void
+grow_alloc_samples(void)
+{
+    unsigned new_buckets = alloc_sample_buckets ? 2 * alloc_sample_buckets
+    : 1024;
+    struct alloc_sample **new_table = calloc(new_buckets,
+					     sizeof(struct alloc_sample *));
+    struct alloc_sample *e, *next;
+    unsigned i;
+
+    if (!new_table)
+	return;
+    for (i = 0; i < alloc_sample_buckets; i++)
+	for (e = alloc_samples[i]; e; e = next) {
+	    next = e->next;
+	    e->next = new_table[ALLOC_SAMPLE_HASH(e->ptr) % new_buckets];
+	    new_table[ALLOC_SAMPLE_HASH(e->ptr) % new_buckets] = e;
+	}
+    free(alloc_samples);
+    alloc_samples = new_table;
+    alloc_sample_buckets = new_buckets;
+}
+
+static void
+sample_allocation(const void *ptr, unsigned size, Memory_Type type)
+{
+    Objid vloc = NOTHING;
+    const char *verbname = "";
+    int line = 0;
+    struct alloc_site *site;
+    struct alloc_sample *e;
+    size_t weight = MAX(size, alloc_sample_interval);
+
+    alloc_sample_countdown = next_sample_gap();
+    if (alloc_sampling)
+	return;
+    alloc_sampling = 1;
+    current_activation_site(&vloc, &verbname, &line);
+    alloc_sampling = 0;
+
+    if (alloc_sample_count >= 2 * alloc_sample_buckets)
+	grow_alloc_samples();
+    if (!alloc_samples
+	|| !(site = find_alloc_site(vloc, verbname, line, type))
+	|| !(e = malloc(sizeof(struct alloc_sample))))
+	return;
+    site->live += weight;
+    site->total += weight;
+    e->ptr = ptr;
+    e->site = site;
+    e->weight = weight;
+    e->next = alloc_samples[ALLOC_SAMPLE_HASH(ptr) % alloc_sample_buckets];
+    alloc_samples[ALLOC_SAMPLE_HASH(ptr) % alloc_sample_buckets] = e;
+    alloc_sample_count++;
+}
+
+static void
+forget_sample(const void *ptr)
+{
+    struct alloc_sample **pe, *e;
+
+    for (pe = &alloc_samples[ALLOC_SAMPLE_HASH(ptr) % alloc_sample_buckets];
+	 (e = *pe); pe = &e->next)
+	if (e->ptr == ptr) {
+	    e->site->live -= e->weight;
+	    *pe = e->next;
+	    free(e);
+	    alloc_sample_count--;
+	    return;
+	}
+}
+
+/* The block sampled at ptr now starts at new_ptr (see myadvance()). */
+static void
+move_sample(const void *ptr, const void *new_ptr)
+{
+    struct alloc_sample **pe, *e;
+
+    for (pe = &alloc_samples[ALLOC_SAMPLE_HASH(ptr) % alloc_sample_buckets];
+	 (e = *pe); pe = &e->next)
+	if (e->ptr == ptr) {
+	    *pe = e->next;
+	    e->ptr = new_ptr;
+	    e->next = alloc_samples[ALLOC_SAMPLE_HASH(new_ptr)
+				    % alloc_sample_buckets];
+	    alloc_samples[ALLOC_SAMPLE_HASH(new_ptr) % alloc_sample_buckets]
+		= e;
+	    return;
+	}
+}
+
+#define NOTE_ALLOCATION(ptr, size, type)			\
+    do {							\
+	if (alloc_sample_interval				\
+	    && (alloc_sample_countdown -= (size)) <= 0)		\
+	    sample_allocation(ptr, size, type);			\
+    } while (0)
+
+#define NOTE_FREE(ptr)						\
+    do {							\
+	if (alloc_sample_count)					\
+	    forget_sample(ptr);					\
+    } while (0)
+
+#define NOTE_MOVE(ptr, new_ptr)					\
+    do {							\
+	if (alloc_sample_count)					\
+	    move_sample(ptr, new_ptr);				\
+    } while (0)
+
+static void
+clear_alloc_profile(void)
+{
+    struct alloc_sample *e, *enext;
+    struct alloc_site *s, *snext;
+    unsigned i;
+
+    for (i = 0; i < alloc_sample_buckets; i++)
+	for (e = alloc_samples[i]; e; e = enext) {
+	    enext = e->next;
+	    free(e);
+	}
+    free(alloc_samples);
+    alloc_samples = 0;
+    alloc_sample_buckets = alloc_sample_count = 0;
+    for (i = 0; i < ALLOC_SITE_BUCKETS; i++) {
+	for (s = alloc_sites[i]; s; s = snext) {
+	    snext = s->next;
+	    free(s->verbname);
+	    free(s);
+	}
+	alloc_sites[i] = 0;
+    }
+}
+
+void
+start_alloc_profile(unsigned interval)
+{
+    clear_alloc_profile();
+    alloc_sample_interval = interval;
+    alloc_sample_countdown = next_sample_gap();
+    alloc_profile_started = time(0);
+    grow_alloc_samples();
+}
+
+void
+stop_alloc_profile(void)
+{
+    alloc_sample_interval = 0;
+    clear_alloc_profile();
+}
+
+/* Returns {seconds, interval, {{vloc, verbname, line, type, live, total},
+ * ...}}, one entry for every site that has been sampled; allocations made
+ * outside any verb are charged to #-1.  Byte figures are clamped to MAXINT.
+ */
+Var
+alloc_profile(void)
+{
+    Var r, sites;
+    struct alloc_site *s;
+    int i, n;
+
+    alloc_sampling = 1;		/* no new sites while we build this */
+    for (i = n = 0; i < ALLOC_SITE_BUCKETS; i++)
+	for (s = alloc_sites[i]; s; s = s->next)
+	    n++;
+
+    sites = new_list(n);
+    for (i = n = 0; i < ALLOC_SITE_BUCKETS; i++)
+	for (s = alloc_sites[i]; s; s = s->next) {
+	    Var l = sites.v.list[++n] = new_list(6);
+
+	    l.v.list[1].type = TYPE_OBJ;
+	    l.v.list[1].v.obj = s->vloc;
+	    l.v.list[2].type = TYPE_STR;
+	    l.v.list[2].v.str = str_dup(s->verbname);
+	    l.v.list[3].type = TYPE_INT;
+	    l.v.list[3].v.num = s->line;
+	    l.v.list[4].type = TYPE_STR;
+	    l.v.list[4].v.str = str_dup(memory_type_names[s->type]);
+	    l.v.list[5].type = l.v.list[6].type = TYPE_INT;
+	    l.v.list[5].v.num = MIN(s->live, (size_t) MAXINT);
+	    l.v.list[6].v.num = MIN(s->total, (size_t) MAXINT);
+	}
+
+    alloc_sampling = 0;
+
+    r = new_list(3);
+    r.v.list[1].type = r.v.list[2].type = TYPE_INT;
+    r.v.list[1].v.num = alloc_sample_interval
+	? time(0) - alloc_profile_started : 0;
+    r.v.list[2].v.num = alloc_sample_interval;
+    r.v.list[3] = sites;
+    return r;
+}
+
 void *
 mymalloc(unsigned size, Memory_Type type)
 {
@@ -67,30 +695,40 @@ mymalloc(unsigned size, Memory_Type type)
 	size = 1;
 
     offs = refcount_overhead(type);
-    memptr = (char *) malloc(size + offs);
-    if (!memptr) {
-	sprintf(msg, "memory allocation (size %u) failed!", size);
-	panic(msg);
-    }
-    alloc_num[type]++;
-#ifdef USE_GNU_MALLOC
+#ifdef USE_SLAB_ALLOCATOR
     {
-	extern unsigned malloc_real_size(void *ptr);
-	extern unsigned malloc_size(void *ptr);
+	int cls = slab_class_of(size + offs, type);
 
-	alloc_size[type] += malloc_size(memptr);
-	alloc_real_size[type] += malloc_real_size(memptr);
+	if (cls >= 0) {
+	    if ((memptr = (char *) slab_alloc(cls)))
+		charge(type, SLAB_BLOCK_SIZE(cls));
+	} else if ((memptr = (char *) heap_alloc(size + offs)))
+	    charge(type, heap_size(memptr));
     }
+#else
+    if ((memptr = (char *) heap_alloc(size + offs)))
+	charge(type, heap_size(memptr));
 #endif
+    if (!memptr) {
+	sprintf(msg, "memory allocation (size %u) failed!", size);
+	panic(msg);
+    }
+    alloc_stats[type].count++;
 
     if (offs) {
 	memptr += offs;
 	((int *) memptr)[-1] = 1;
+	block_front(memptr, type) = 0;
 #ifdef MEMO_STRLEN
 	if (type == M_STRING)
 	    ((int *) memptr)[-2] = size - 1;
 #endif /* MEMO_STRLEN */
+#ifdef MEMO_STRHASH
+	if (type == M_STRING)
+	    forget_strhash(memptr);
+#endif /* MEMO_STRHASH */
     }
+    NOTE_ALLOCATION(memptr, size, type);
     return memptr;
 }
 
@@ -122,52 +760,176 @@ str_dup(const char *s)
     return r;
 }
 
+/* One-character strings are handed out from a permanent table, so that
+ * indexing into a string does not allocate.  The table holds its own
+ * reference to every entry; nobody else ever sees a refcount of 1 on one,
+ * so the in-place update paths always copy them rather than write to them.
+ * (Short strings are not kept inside the Var itself: Vars are copied by
+ * value everywhere, and v.str must stay a pointer that outlives the copy
+ * it was read from, so such a string would have to be turned back into an
+ * allocated one nearly everywhere it is used.)
+ */
+const char *
+str_dup_char(char c)
+{
+    static char *table[256];
+    char *s = table[(unsigned char) c];
+
+    if (c == '\0')
+	return str_dup("");
+    if (!s) {
+	s = table[(unsigned char) c] = (char *) mymalloc(2, M_STRING);
+	s[0] = c;
+	s[1] = '\0';
+    }
+    addref(s);
+    return s;
+}
+
 void *
 myrealloc(void *ptr, unsigned size, Memory_Type type)
 {
-    int offs = refcount_overhead(type);
     static char msg[100];
+    char *old = block_of(ptr, type);
+    int lead = (char *) ptr - old;	/* header, and anything in front */
 
-#ifdef USE_GNU_MALLOC
-    {
-	extern unsigned malloc_real_size(void *ptr);
-	extern unsigned malloc_size(void *ptr);
+    NOTE_FREE(ptr);
+#ifdef USE_SLAB_ALLOCATOR
+    struct slab_page *p = ((type == M_STRING || type == M_LIST)
+			   ? slab_page_of(old) : 0);
 
-	alloc_size[type] -= malloc_size(ptr);
-	alloc_real_size[type] -= malloc_real_size(ptr);
+    if (p) {
+	int cls = slab_class_of(size + lead, type);
+
+	if (cls == p->cls)
+	    ptr = old;
+	else if (cls >= 0 ? (ptr = slab_alloc(cls)) != 0
+		 : (ptr = heap_alloc(size + lead)) != 0) {
+	    memcpy(ptr, old, MIN(SLAB_BLOCK_SIZE(p->cls), size + lead));
+	    discharge(type, SLAB_BLOCK_SIZE(p->cls));
+	    charge(type, cls >= 0 ? SLAB_BLOCK_SIZE(cls) : heap_size(ptr));
+	    slab_free(p, old);
+	}
+    } else
 #endif
+    {
+	size_t old_bytes = heap_size(old);
 
-	ptr = realloc((char *) ptr - offs, size + offs);
-	if (!ptr) {
-	    sprintf(msg, "memory re-allocation (size %u) failed!", size);
-	    panic(msg);
+	if ((ptr = heap_realloc(old, size + lead))) {
+	    discharge(type, old_bytes);
+	    charge(type, heap_size(ptr));
 	}
-#ifdef USE_GNU_MALLOC
-	alloc_size[type] += malloc_size(ptr);
-	alloc_real_size[type] += malloc_real_size(ptr);
     }
+    if (!ptr) {
+	sprintf(msg, "memory re-allocation (size %u) failed!", size);
+	panic(msg);
+    }
+    ptr = (char *) ptr + lead;
+#ifdef MEMO_STRLEN
+    if (type == M_STRING)
+	memo_strlen_slot(ptr) = size - 1;
+#endif /* MEMO_STRLEN */
+#ifdef MEMO_STRHASH
+    if (type == M_STRING)
+	forget_strhash(ptr);
+#endif /* MEMO_STRHASH */
+    NOTE_ALLOCATION(ptr, size, type);
+
+    return ptr;
+}
+
+/* Dropping a prefix of a string or list in place.
+ *
+ * The value is left where it is and a new header is written just below
+ * the first byte kept, over the bytes being dropped; the distance from the
+ * block's start is recorded with block_front() so that the block can still
+ * be freed or reallocated.  A string may end up starting at any byte; its
+ * header then goes below the int boundary under it (see ref_header()),
+ * which always leaves room, the old header having been at least that far
+ * down.  The bytes skipped stay with the block until it is freed or
+ * reallocated, so callers should copy instead once myslack() gets large
+ * next to the value.
+ */
+void *
+myadvance(void *ptr, unsigned skip, Memory_Type type)
+{
+    char *block = block_of(ptr, type);
+    char *r = (char *) ptr + skip;
+    int count = refcount(ptr);
+#ifdef MEMO_STRLEN
+    int len = type == M_STRING ? memo_strlen(ptr) : 0;
 #endif
 
-    return (char *) ptr + offs;
+    NOTE_MOVE(ptr, r);
+    refcount(r) = count;
+    block_front(r, type) = ((char *) ref_header(r) - refcount_overhead(type)
+			    - block);
+#ifdef MEMO_STRLEN
+    if (type == M_STRING)
+	memo_strlen_slot(r) = len - skip;
+#endif /* MEMO_STRLEN */
+#ifdef MEMO_STRHASH
+    if (type == M_STRING)
+	forget_strhash(r);
+#endif /* MEMO_STRHASH */
+    return r;
+}
+
+unsigned
+myslack(const void *ptr, Memory_Type type)
+{
+    return (const char *) ptr - block_of(ptr, type) - refcount_overhead(type);
 }
 
 void
 myfree(void *ptr, Memory_Type type)
 {
-    alloc_num[type]--;
-#ifdef USE_GNU_MALLOC
-    {
-	extern unsigned malloc_real_size(void *ptr);
-	extern unsigned malloc_size(void *ptr);
+    void *base = block_of(ptr, type);
+
+    alloc_stats[type].count--;
+    NOTE_FREE(ptr);
+#ifdef USE_SLAB_ALLOCATOR
+    if (type == M_STRING || type == M_LIST) {
+	struct slab_page *p = slab_page_of(base);
 
-	alloc_size[type] -= malloc_size(ptr);
-	alloc_real_size[type] -= malloc_real_size(ptr);
+	if (p) {
+	    discharge(type, SLAB_BLOCK_SIZE(p->cls));
+	    slab_free(p, base);
+	    return;
+	}
     }
 #endif
+    discharge(type, heap_size(base));
+    heap_free(base);
+}
+
+#ifdef USE_RECLAIMER_THREAD
+
+size_t
+myfree_detached(void *ptr, Memory_Type type)
+{
+    void *base = block_of(ptr, type);
+    size_t bytes = heap_size(base);
+
+    heap_free(base);
+    return bytes;
+}
+
+void
+myfree_settle(Memory_Type type, unsigned count, size_t bytes)
+{
+    alloc_stats[type].count -= count;
+    discharge(type, bytes);
+}
 
-    free((char *) ptr - refcount_overhead(type));
+int
+alloc_profile_active(void)
+{
+    return alloc_sample_interval || alloc_sample_count;
 }
 
+#endif				/* USE_RECLAIMER_THREAD */
+
 #ifdef USE_GNU_MALLOC
 struct mstats_value {
     int blocksize;
@@ -222,6 +984,22 @@ memory_usage(void)
 	l.v.list[2].v.num = v.nused;
 	l.v.list[3].v.num = v.nfree;
     }
+#elif defined(USE_SLAB_ALLOCATOR)
+    int i;
+
+    /* Get all of the allocation out of the way before getting the stats. */
+    r = new_list(SLAB_CLASSES);
+    for (i = 1; i <= SLAB_CLASSES; i++)
+	r.v.list[i] = new_list(3);
+
+    for (i = 0; i < SLAB_CLASSES; i++) {
+	Var l = r.v.list[i + 1];
+
+	l.v.list[1].type = l.v.list[2].type = l.v.list[3].type = TYPE_INT;
+	l.v.list[1].v.num = SLAB_BLOCK_SIZE(i);
+	l.v.list[2].v.num = slab_classes[i].nused;
+	l.v.list[3].v.num = slab_classes[i].nfree;
+    }
 #else
     r = new_list(0);
 #endif
@@ -229,6 +1007,76 @@ memory_usage(void)
     return r;
 }
 
+/* Returns {{name, count, bytes, peak}, ...} for each Memory_Type that has
+ * ever been allocated, then a "deferred_free" entry for lists waiting on
+ * free_deferred_values() (their bytes are still counted under "list");
+ * byte figures are clamped to MAXINT.
+ */
+Var
+memory_type_usage(void)
+{
+    Var r;
+    struct alloc_stats snap[Sizeof_Memory_Type];
+    int i, n;
+
+    memcpy(snap, alloc_stats, sizeof(snap));
+    for (i = n = 0; i < Sizeof_Memory_Type; i++)
+	if (snap[i].peak)
+	    n++;
+
+    r = new_list(n + 1);
+    for (i = n = 0; i < Sizeof_Memory_Type; i++) {
+	Var l;
+
+	if (!snap[i].peak)
+	    continue;
+	l = r.v.list[++n] = new_list(4);
+	l.v.list[1].type = TYPE_STR;
+	l.v.list[1].v.str = str_dup(memory_type_names[i]);
+	l.v.list[2].type = l.v.list[3].type = l.v.list[4].type = TYPE_INT;
+	l.v.list[2].v.num = snap[i].count;
+	l.v.list[3].v.num = MIN(snap[i].bytes, (size_t) MAXINT);
+	l.v.list[4].v.num = MIN(snap[i].peak, (size_t) MAXINT);
+    }
+    {
+	unsigned count;
+	size_t bytes, peak;
+	Var l = r.v.list[++n] = new_list(4);
+
+	deferred_free_usage(&count, &bytes, &peak);
+	l.v.list[1].type = TYPE_STR;
+	l.v.list[1].v.str = str_dup("deferred_free");
+	l.v.list[2].type = l.v.list[3].type = l.v.list[4].type = TYPE_INT;
+	l.v.list[2].v.num = count;
+	l.v.list[3].v.num = MIN(bytes, (size_t) MAXINT);
+	l.v.list[4].v.num = MIN(peak, (size_t) MAXINT);
+    }
+
+    return r;
+}
+
+void
+log_memory_type_usage(void)
+{
+    int i;
+
+    for (i = 0; i < Sizeof_Memory_Type; i++)
+	if (alloc_stats[i].peak)
+	    oklog("MEMORY: %-14s %9u blocks %12lu bytes (peak %lu)\n",
+		  memory_type_names[i], alloc_stats[i].count,
+		  (unsigned long) alloc_stats[i].bytes,
+		  (unsigned long) alloc_stats[i].peak);
+    {
+	unsigned count;
+	size_t bytes, peak;
+
+	deferred_free_usage(&count, &bytes, &peak);
+	oklog("MEMORY: %-14s %9u lists  %12lu bytes (peak %lu)\n",
+	      "deferred_free", count, (unsigned long) bytes,
+	      (unsigned long) peak);
+    }
+}
+
 char rcsid_storage[] = "$Id$";
 
 /* 
@@ -20,12 +20,13 @@
 
 #include "my-string.h"
 
+#include "options.h"
 #include "structures.h"
 #include "ref_count.h"
 
 typedef enum Memory_Type {
     M_AST_POOL, M_AST, M_PROGRAM, M_PVAL, M_NETWORK, M_STRING, M_VERBDEF,
-    M_LIST, M_PREP, M_PROPDEF, M_OBJECT_TABLE, M_OBJECT, M_FLOAT,
+    M_LIST, M_PREP, M_PROPDEF, M_OBJECT_TABLE, M_OBJECT,
     M_STREAM, M_NAMES, M_ENV, M_TASK, M_PATTERN,
 
     M_BYTECODES, M_FORK_VECTORS, M_LIT_LIST,
@@ -34,7 +35,10 @@ typedef enum Memory_Type {
     M_RT_STACK, M_RT_ENV, M_BI_FUNC_DATA, M_VM,
 
     M_REF_ENTRY, M_REF_TABLE, M_VC_ENTRY, M_VC_TABLE, M_STRING_PTRS,
-    M_INTERN_POINTER, M_INTERN_ENTRY, M_INTERN_HUNK,
+    M_INTERN_POINTER, M_INTERN_ENTRY, M_INTERN_HUNK, M_PROP_INDEX,
+    M_VERB_MATCHER, M_NAME_INDEX,
+
+    /* each type above needs a name in memory_type_names[], storage.c */
 
     Sizeof_Memory_Type
 
@@ -42,11 +46,36 @@ typedef enum Memory_Type {
 
 extern char *str_dup(const char *);
 extern const char *str_ref(const char *);
+extern const char *str_dup_char(char);
 extern Var memory_usage(void);
+extern Var memory_type_usage(void);
+extern void log_memory_type_usage(void);
+extern void start_alloc_profile(unsigned interval);
+extern void stop_alloc_profile(void);
+extern Var alloc_profile(void);
+
+#ifdef USE_RECLAIMER_THREAD
+/* For the reclaimer thread (see utils.c): free a block without touching
+ * the allocator's books, returning the bytes released so that the main
+ * thread can settle up later with myfree_settle().  Not for use while the
+ * allocation profiler is on.
+ */
+extern size_t myfree_detached(void *where, Memory_Type type);
+extern void myfree_settle(Memory_Type type, unsigned count, size_t bytes);
+extern int alloc_profile_active(void);
+#endif
 
 extern void myfree(void *where, Memory_Type type);
 extern void *mymalloc(unsigned size, Memory_Type type);
 extern void *myrealloc(void *where, unsigned size, Memory_Type type);
+extern void *myadvance(void *where, unsigned skip, Memory_Type type);
+extern unsigned myslack(const void *where, Memory_Type type);
+				/* For a string or list whose only reference
+				 * the caller holds: drop its first skip
+				 * bytes without moving the rest, and say how
+				 * many bytes of its block lie dead in front
+				 * of it.
+				 */
 
 static inline void		/* XXX was extern, fix for non-gcc compilers */
 free_str(const char *s)
@@ -60,12 +89,44 @@ free_str(const char *s)
  * Using the same mechanism as ref_count.h uses to hide Value ref counts,
  * keep a memozied strlen in the storage with the string.
  */
-#define memo_strlen(X)		((void)0, (((int *)(X))[-2]))
+#define memo_strlen(X)		((void)0, memo_strlen_slot(X))
+#define memo_strlen_slot(X)	(ref_header(X)[-2])	/* for setting it */
 #else
 #define memo_strlen(X)		strlen(X)
 
 #endif /* MEMO_STRLEN */
 
+#ifdef MEMO_STRHASH
+/*
+ * Likewise, a memoized str_hash() (see str_hash_memo() in utils.h), kept
+ * in the word below the refcount and the memoized length.  Zero means not
+ * yet computed.  Anything that changes a string in place must forget it.
+ */
+#ifdef MEMO_STRLEN
+#define memo_strhash(X)		(((unsigned *) ref_header(X))[-3])
+#else
+#define memo_strhash(X)		(((unsigned *) ref_header(X))[-2])
+#endif /* MEMO_STRLEN */
+#define forget_strhash(X)	(memo_strhash(X) = 0)
+#else
+#define forget_strhash(X)	((void)0)
+#endif /* MEMO_STRHASH */
+
+/*
+ * Below all of that, strings and lists keep the number of bytes of their
+ * block that lie in front of the header: zero, unless myadvance() has
+ * dropped a prefix of the value in place.
+ */
+#if defined(MEMO_STRLEN) && defined(MEMO_STRHASH)
+#define STR_FRONT_SLOT		4
+#elif defined(MEMO_STRLEN) || defined(MEMO_STRHASH)
+#define STR_FRONT_SLOT		3
+#else
+#define STR_FRONT_SLOT		2
+#endif
+#define block_front(X, type)	\
+	(ref_header(X)[(type) == M_STRING ? -STR_FRONT_SLOT : -2])
+
 #endif				/* Storage_h */
 
 /* 
@@ -1,10 +1,143 @@
 #include "my-stdlib.h"
+#include "my-string.h"
 
 #include "log.h"
 #include "storage.h"
 #include "str_intern.h"
 #include "utils.h"
 
+/* The name table.
+ *
+ * Property names, verb names and identifier-like program literals are
+ * interned here for the life of the server, so that the same name used
+ * in different places is normally the same pointer and lookups can
+ * compare pointers before falling back to mystrcasecmp().  Matching is
+ * exact (names keep their case); the hash is str_hash(), which folds
+ * case, so it can be reused by callers that keep one.  Each entry holds
+ * a reference to its string; entries nobody else refers to any more are
+ * swept out before the table is allowed to grow.
+ */
+
+struct name_entry {
+    const char *s;
+    unsigned hash;
+    struct name_entry *next;
+};
+
+static struct name_entry **name_table = NULL;
+static int name_table_size = 0;
+static int name_table_count = 0;
+
+#define NAME_TABLE_SIZE_INITIAL 4099
+
+/* Does the NUL-terminated string t hold exactly the len bytes at s? */
+static int
+same_span(const char *t, const char *s, int len)
+{
+    return memo_strlen(t) == len && !memcmp(t, s, len);
+}
+
+static const char *
+find_name(const char *s, int len, unsigned hash)
+{
+    struct name_entry *e;
+
+    if (!name_table)
+	return NULL;
+    for (e = name_table[hash % name_table_size]; e; e = e->next)
+	if (e->hash == hash && same_span(e->s, s, len))
+	    return e->s;
+    return NULL;
+}
+
+/* A fresh string holding the len bytes at s. */
+static const char *
+span_dup(const char *s, int len)
+{
+    char *r;
+
+    if (len == 0)
+	return str_dup("");
+    r = mymalloc(len + 1, M_STRING);
+    memcpy(r, s, len);
+    r[len] = '\0';
+    return r;
+}
+
+static void
+sweep_names(void)
+{
+    struct name_entry **pe, *e;
+    int i;
+
+    for (i = 0; i < name_table_size; i++)
+	for (pe = &name_table[i]; (e = *pe);) {
+	    if (refcount(e->s) == 1) {
+		*pe = e->next;
+		free_str(e->s);
+		myfree(e, M_INTERN_ENTRY);
+		name_table_count--;
+	    } else
+		pe = &e->next;
+	}
+}
+
+static void
+resize_name_table(int new_size)
+{
+    struct name_entry **new_table, *e, *next;
+    int i;
+
+    new_table = mymalloc(sizeof(struct name_entry *) * new_size,
+			 M_INTERN_POINTER);
+    for (i = 0; i < new_size; i++)
+	new_table[i] = NULL;
+    for (i = 0; i < name_table_size; i++)
+	for (e = name_table[i]; e; e = next) {
+	    next = e->next;
+	    e->next = new_table[e->hash % new_size];
+	    new_table[e->hash % new_size] = e;
+	}
+    if (name_table)
+	myfree(name_table, M_INTERN_POINTER);
+    name_table = new_table;
+    name_table_size = new_size;
+}
+
+const char *
+str_intern_name(const char *s)
+{
+    struct name_entry *e;
+    unsigned hash;
+    const char *r;
+
+    if (s == NULL || *s == '\0')
+	return str_dup(s);
+
+    hash = str_hash(s);
+    if ((r = find_name(s, strlen(s), hash)) != NULL)
+	return str_ref(r);
+
+    if (!name_table)
+	resize_name_table(NAME_TABLE_SIZE_INITIAL);
+    else if (name_table_count >= name_table_size) {
+	sweep_names();
+	if (name_table_count >= name_table_size / 2)
+	    resize_name_table(name_table_size * 2 + 1);
+    }
+    e = mymalloc(sizeof(struct name_entry), M_INTERN_ENTRY);
+    e->s = str_dup(s);
+#ifdef MEMO_STRHASH
+    memo_strhash(e->s) = hash;
+#endif
+    e->hash = hash;
+    e->next = name_table[hash % name_table_size];
+    name_table[hash % name_table_size] = e;
+    name_table_count++;
+
+    return str_ref(e->s);
+}
+
 #ifdef STRING_INTERNING
 
 struct intern_entry {
@@ -151,14 +284,14 @@ str_intern_close(void)
 }
 
 static struct intern_entry *
-find_interned_string(const char *s, unsigned hash)
+find_interned_string(const char *s, int len, unsigned hash)
 {
     int bucket = hash % intern_table_size;
     struct intern_entry *p;
     
     for (p = intern_table[bucket]; p; p = p->next) {
         if (hash == p->hash) {
-            if (!strcmp(s, p->s)) {
+            if (same_span(p->s, s, len)) {
                 return p;
             }
         }
@@ -223,27 +356,42 @@ intern_rehash(int new_size) {
    possibly share storage. */
 const char *
 str_intern(const char *s)
+{
+    if (s == NULL) {
+        return str_dup(s);
+    }
+
+    return str_intern_span(s, strlen(s));
+}
+
+/* Likewise, for the len bytes at s, which need not be NUL-terminated;
+   they are only copied if no interned string already holds them. */
+const char *
+str_intern_span(const char *s, int len)
 {
     struct intern_entry *e;
     unsigned hash;
     const char *r;
     
-    if (s == NULL || *s == '\0') {
+    if (len == 0) {
         /* str_dup already has a canonical empty string */
-        return str_dup(s);
+        return str_dup("");
     }
     
     if (intern_table == NULL) {
-        return str_dup(s);
+        return span_dup(s, len);
     }
     
-    hash = str_hash(s);
+    hash = str_hash_span(s, len);
     
-    e = find_interned_string(s, hash);
+    if ((r = find_name(s, len, hash)) != NULL)
+        return str_ref(r);
+
+    e = find_interned_string(s, len, hash);
     
     if (e != NULL) {
         intern_allocations_saved++;
-        intern_bytes_saved += memo_strlen(e->s);
+        intern_bytes_saved += len;
         return str_ref(e->s);
     }
     
@@ -251,7 +399,10 @@ str_intern(const char *s)
         intern_rehash(intern_table_size * 2);
     }
     
-    r = str_dup(s);
+    r = span_dup(s, len);
+#ifdef MEMO_STRHASH
+    memo_strhash(r) = hash;
+#endif
     r = str_ref(r);
     add_interned_string(r, hash);
     
@@ -266,6 +417,12 @@ str_intern(const char *s)
 	return str_dup(s);
 }
 
+const char *
+str_intern_span(const char *s, int len)
+{
+	return span_dup(s, len);
+}
+
 void
 str_intern_close(void)
 {
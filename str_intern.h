@@ -22,4 +22,12 @@ extern void str_intern_close(void);
    possibly share storage. */
 extern const char *str_intern(const char *s);
 
+/* Likewise, for the len bytes at s, which need not be NUL-terminated.
+   Nothing is copied if an interned string already holds them. */
+extern const char *str_intern_span(const char *s, int len);
+
+/* Return a reference to the permanent shared copy of the name s,
+   creating it if need be.  Used for property and verb names. */
+extern const char *str_intern_name(const char *s);
+
 #endif
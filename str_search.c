@@ -0,0 +1,506 @@
+#include "my-string.h"
+
+#include "config.h"
+#include "utils.h"
+
+/* Case-folding comparison, hashing and substring search on strings.
+ *
+ * Nothing here allocates or touches MOO values, so this file can be
+ * linked on its own; strbench.c does so to time these routines.
+ */
+
+/*
+ * These versions of strcasecmp() and strncasecmp() depend on ASCII.
+ * We implement them here because neither one is in the ANSI standard.
+ */
+
+static const char cmap[] =
+"\000\001\002\003\004\005\006\007\010\011\012\013\014\015\016\017"
+"\020\021\022\023\024\025\026\027\030\031\032\033\034\035\036\037"
+"\040\041\042\043\044\045\046\047\050\051\052\053\054\055\056\057"
+"\060\061\062\063\064\065\066\067\070\071\072\073\074\075\076\077"
+"\100\141\142\143\144\145\146\147\150\151\152\153\154\155\156\157"
+"\160\161\162\163\164\165\166\167\170\171\172\133\134\135\136\137"
+"\140\141\142\143\144\145\146\147\150\151\152\153\154\155\156\157"
+"\160\161\162\163\164\165\166\167\170\171\172\173\174\175\176\177"
+"\200\201\202\203\204\205\206\207\210\211\212\213\214\215\216\217"
+"\220\221\222\223\224\225\226\227\230\231\232\233\234\235\236\237"
+"\240\241\242\243\244\245\246\247\250\251\252\253\254\255\256\257"
+"\260\261\262\263\264\265\266\267\270\271\272\273\274\275\276\277"
+"\300\301\302\303\304\305\306\307\310\311\312\313\314\315\316\317"
+"\320\321\322\323\324\325\326\327\330\331\332\333\334\335\336\337"
+"\340\341\342\343\344\345\346\347\350\351\352\353\354\355\356\357"
+"\360\361\362\363\364\365\366\367\370\371\372\373\374\375\376\377";
+
+/*
+ * Vector versions of the cmap[] folding, used by the comparison and
+ * search routines below.  Only 'A'..'Z' fold: adding 0x80 - 'A' moves
+ * them to the bottom of the signed byte range, where one signed compare
+ * picks them out.  SSE2 is part of the x86-64 baseline; AVX2 is used for
+ * the substring searches when the running CPU has it.
+ *
+ * mystrcasecmp() and mystrncasecmp() don't know their lengths, and
+ * finding them first would mean reading both strings twice.  Instead
+ * they load 16 bytes at a time, but only where the load stays within
+ * one page, and look at nothing past the first NUL or difference.  The
+ * load may take in bytes beyond the end of the string, which would be
+ * an error for an ordinary C access, but the hardware cannot fault on
+ * them (memory protection works on whole pages) and their values never
+ * affect the result; glibc's own strlen() works the same way.  They
+ * are marked NO_SANITIZE_ADDRESS so that AddressSanitizer, which would
+ * report the bytes past the end, leaves them alone.  The searches know
+ * both lengths and never load outside the strings.
+ */
+
+#if defined(__GNUC__) && defined(__SSE2__)
+#define SIMD_STRINGS 1
+
+#include <emmintrin.h>
+
+#define CROSSES_PAGE(P, N) ((((unsigned long) (P)) & 4095) > 4096 - (N))
+
+#if __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 8) \
+    || defined(__clang__)
+#define NO_SANITIZE_ADDRESS __attribute__ ((no_sanitize_address))
+#endif
+
+static inline __m128i
+fold16(__m128i x)
+{
+    __m128i upper = _mm_cmplt_epi8(_mm_add_epi8(x, _mm_set1_epi8(0x80 - 'A')),
+				   _mm_set1_epi8(-128 + 26));
+
+    return _mm_or_si128(x, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+}
+
+/* Bit i is set iff s[i] and t[i] differ after folding or s[i] is NUL. */
+NO_SANITIZE_ADDRESS
+static inline unsigned
+casecmp_stops16(const unsigned char *s, const unsigned char *t)
+{
+    __m128i a = _mm_loadu_si128((const __m128i *) s);
+    __m128i b = _mm_loadu_si128((const __m128i *) t);
+    __m128i same = _mm_cmpeq_epi8(fold16(a), fold16(b));
+    __m128i nul = _mm_cmpeq_epi8(a, _mm_setzero_si128());
+
+    return ~_mm_movemask_epi8(_mm_andnot_si128(nul, same)) & 0xFFFF;
+}
+
+#if (__GNUC__ >= 5 || defined(__clang__)) \
+    && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_STRINGS_AVX2 1
+
+#include <immintrin.h>
+
+static int
+have_avx2(void)
+{
+    static int known = -1;
+
+    if (known < 0)
+	known = __builtin_cpu_supports("avx2") ? 1 : 0;
+    return known;
+}
+#endif				/* AVX2 */
+
+#endif				/* SIMD_STRINGS */
+
+#ifndef NO_SANITIZE_ADDRESS
+#define NO_SANITIZE_ADDRESS
+#endif
+
+NO_SANITIZE_ADDRESS
+int
+mystrcasecmp(const char *ss, const char *tt)
+{
+    register const unsigned char *s = (const unsigned char *) ss;
+    register const unsigned char *t = (const unsigned char *) tt;
+
+    if (s == t) {
+	return 0;
+    }
+#ifdef SIMD_STRINGS
+    while (!CROSSES_PAGE(s, 16) && !CROSSES_PAGE(t, 16)) {
+	unsigned stops = casecmp_stops16(s, t);
+
+	if (stops) {
+	    int i = __builtin_ctz(stops);
+
+	    return (cmap[s[i]] - cmap[t[i]]);
+	}
+	s += 16;
+	t += 16;
+    }
+#endif
+    while (cmap[*s] == cmap[*t++]) {
+	if (!*s++)
+	    return 0;
+    }
+    return (cmap[*s] - cmap[*--t]);
+}
+
+NO_SANITIZE_ADDRESS
+int
+mystrncasecmp(const char *ss, const char *tt, int n)
+{
+    const unsigned char *s = (const unsigned char *) ss;
+    const unsigned char *t = (const unsigned char *) tt;
+
+    if (!n || ss == tt)
+	return 0;
+#ifdef SIMD_STRINGS
+    while (n > 0 && !CROSSES_PAGE(s, 16) && !CROSSES_PAGE(t, 16)) {
+	unsigned stops = casecmp_stops16(s, t);
+
+	if (stops) {
+	    int i = __builtin_ctz(stops);
+
+	    return i >= n ? 0 : (cmap[s[i]] - cmap[t[i]]);
+	}
+	if (n <= 16)
+	    return 0;
+	n -= 16;
+	s += 16;
+	t += 16;
+    }
+#endif
+    while (cmap[*s] == cmap[*t++]) {
+	if (!*s++ || !--n)
+	    return 0;
+    }
+    return (cmap[*s] - cmap[*--t]);
+}
+
+/* True iff the N bytes at S and T are equal, ignoring case if !CASE_COUNTS. */
+static inline int
+bytes_equal(const unsigned char *s, const unsigned char *t, int n,
+	    int case_counts)
+{
+    if (case_counts)
+	return !memcmp(s, t, n);
+#ifdef SIMD_STRINGS
+    for (; n >= 16; n -= 16, s += 16, t += 16) {
+	__m128i a = fold16(_mm_loadu_si128((const __m128i *) s));
+	__m128i b = fold16(_mm_loadu_si128((const __m128i *) t));
+
+	if (_mm_movemask_epi8(_mm_cmpeq_epi8(a, b)) != 0xFFFF)
+	    return 0;
+    }
+#endif
+    for (; n > 0; n--)
+	if (cmap[*s++] != cmap[*t++])
+	    return 0;
+    return 1;
+}
+
+int
+str_bytes_equal(const char *s, const char *t, int n, int case_counts)
+{
+    return bytes_equal((const unsigned char *) s, (const unsigned char *) t,
+		       n, case_counts);
+}
+
+int
+verbcasecmp(const char *verb, const char *word)
+{
+    const unsigned char *w;
+    const unsigned char *v = (const unsigned char *) verb;
+    enum {
+	none, inner, end
+    } star;
+
+    if (verb == word) {
+	return 1;
+    }
+    while (*v) {
+	w = (const unsigned char *) word;
+	star = none;
+	while (1) {
+	    while (*v == '*') {
+		v++;
+		star = (!*v || *v == ' ') ? end : inner;
+	    }
+	    if (!*v || *v == ' ' || !*w || cmap[*w] != cmap[*v])
+		break;
+	    w++;
+	    v++;
+	}
+	if (!*w ? (star != none || !*v || *v == ' ')
+	    : (star == end))
+	    return 1;
+	while (*v && *v != ' ')
+	    v++;
+	while (*v == ' ')
+	    v++;
+    }
+    return 0;
+}
+
+unsigned
+str_hash(const char *s)
+{
+    register unsigned ans = 0;
+
+    while (*s) {
+	ans = (ans << 3) + (ans >> 28) + cmap[(unsigned char) *s++];
+    }
+    return ans;
+}
+
+/* str_hash() of the len bytes at s, which need not be NUL-terminated. */
+unsigned
+str_hash_span(const char *s, int len)
+{
+    register unsigned ans = 0;
+
+    while (len-- > 0) {
+	ans = (ans << 3) + (ans >> 28) + cmap[(unsigned char) *s++];
+    }
+    return ans;
+}
+
+/*
+ * Substring search.  Candidate positions are those where both the first
+ * and the last byte of WHAT match (after folding, unless CASE_COUNTS);
+ * the vector loops test a whole block of candidates at once and only the
+ * survivors are compared in full.  Each scanner handles the blocks that
+ * fit entirely inside SOURCE, updating *POS past what it has covered, and
+ * returns the offset of a match or -1; the scalar loop finishes the rest.
+ */
+
+#ifdef SIMD_STRINGS
+static int
+scan_forward_sse2(const unsigned char *src, int *pos, int last,
+		  const unsigned char *what, int lwhat, int case_counts)
+{
+    __m128i first = _mm_set1_epi8(cmap[what[0]]);
+    __m128i final = _mm_set1_epi8(cmap[what[lwhat - 1]]);
+    int i;
+
+    if (case_counts) {
+	first = _mm_set1_epi8(what[0]);
+	final = _mm_set1_epi8(what[lwhat - 1]);
+    }
+    for (i = *pos; i + 15 <= last; i += 16) {
+	__m128i a = _mm_loadu_si128((const __m128i *) (src + i));
+	__m128i b = _mm_loadu_si128((const __m128i *) (src + i + lwhat - 1));
+	unsigned mask;
+
+	if (!case_counts) {
+	    a = fold16(a);
+	    b = fold16(b);
+	}
+	mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first),
+					       _mm_cmpeq_epi8(b, final)));
+	while (mask) {
+	    int j = i + __builtin_ctz(mask);
+
+	    if (bytes_equal(src + j, what, lwhat, case_counts))
+		return j;
+	    mask &= mask - 1;
+	}
+    }
+    *pos = i;
+    return -1;
+}
+
+static int
+scan_backward_sse2(const unsigned char *src, int *pos,
+		   const unsigned char *what, int lwhat, int case_counts)
+{
+    __m128i first = _mm_set1_epi8(cmap[what[0]]);
+    __m128i final = _mm_set1_epi8(cmap[what[lwhat - 1]]);
+    int i;
+
+    if (case_counts) {
+	first = _mm_set1_epi8(what[0]);
+	final = _mm_set1_epi8(what[lwhat - 1]);
+    }
+    for (i = *pos; i >= 15; i -= 16) {
+	const unsigned char *block = src + i - 15;
+	__m128i a = _mm_loadu_si128((const __m128i *) block);
+	__m128i b = _mm_loadu_si128((const __m128i *) (block + lwhat - 1));
+	unsigned mask;
+
+	if (!case_counts) {
+	    a = fold16(a);
+	    b = fold16(b);
+	}
+	mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first),
+					       _mm_cmpeq_epi8(b, final)));
+	while (mask) {
+	    int j = 31 - __builtin_clz(mask);
+
+	    if (bytes_equal(block + j, what, lwhat, case_counts))
+		return block + j - src;
+	    mask &= ~(1u << j);
+	}
+    }
+    *pos = i;
+    return -1;
+}
+#endif				/* SIMD_STRINGS */
+
+#ifdef SIMD_STRINGS_AVX2
+__attribute__ ((target("avx2"), always_inline))
+static inline __m256i
+fold32(__m256i x)
+{
+    __m256i upper = _mm256_cmpgt_epi8(_mm256_set1_epi8(-128 + 26),
+				      _mm256_add_epi8(x,
+						      _mm256_set1_epi8(0x80 - 'A')));
+
+    return _mm256_or_si256(x, _mm256_and_si256(upper,
+					       _mm256_set1_epi8(0x20)));
+}
+
+__attribute__ ((target("avx2"), always_inline))
+static inline unsigned
+candidates32(const unsigned char *p, int lwhat, __m256i first, __m256i final,
+	     int case_counts)
+{
+    __m256i a = _mm256_loadu_si256((const __m256i *) p);
+    __m256i b = _mm256_loadu_si256((const __m256i *) (p + lwhat - 1));
+
+    if (!case_counts) {
+	a = fold32(a);
+	b = fold32(b);
+    }
+    return _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first),
+						 _mm256_cmpeq_epi8(b, final)));
+}
+
+__attribute__ ((target("avx2")))
+static int
+scan_forward_avx2(const unsigned char *src, int *pos, int last,
+		  const unsigned char *what, int lwhat, int case_counts)
+{
+    unsigned char f = case_counts ? what[0] : cmap[what[0]];
+    unsigned char l = case_counts ? what[lwhat - 1] : cmap[what[lwhat - 1]];
+    __m256i first = _mm256_set1_epi8(f);
+    __m256i final = _mm256_set1_epi8(l);
+    int i;
+
+    for (i = *pos; i + 31 <= last; i += 32) {
+	unsigned mask = candidates32(src + i, lwhat, first, final, case_counts);
+
+	while (mask) {
+	    int j = i + __builtin_ctz(mask);
+
+	    if (bytes_equal(src + j, what, lwhat, case_counts))
+		return j;
+	    mask &= mask - 1;
+	}
+    }
+    *pos = i;
+    return -1;
+}
+
+__attribute__ ((target("avx2")))
+static int
+scan_backward_avx2(const unsigned char *src, int *pos,
+		   const unsigned char *what, int lwhat, int case_counts)
+{
+    unsigned char f = case_counts ? what[0] : cmap[what[0]];
+    unsigned char l = case_counts ? what[lwhat - 1] : cmap[what[lwhat - 1]];
+    __m256i first = _mm256_set1_epi8(f);
+    __m256i final = _mm256_set1_epi8(l);
+    int i;
+
+    for (i = *pos; i >= 31; i -= 32) {
+	const unsigned char *block = src + i - 31;
+	unsigned mask = candidates32(block, lwhat, first, final, case_counts);
+
+	while (mask) {
+	    int j = 31 - __builtin_clz(mask);
+
+	    if (bytes_equal(block + j, what, lwhat, case_counts))
+		return block + j - src;
+	    mask &= ~(1u << j);
+	}
+    }
+    *pos = i;
+    return -1;
+}
+#endif				/* SIMD_STRINGS_AVX2 */
+
+/* Offset of the first occurrence of WHAT in the LSRC bytes at SOURCE
+ * that starts at or after FROM, or -1 if there is none.
+ */
+int
+str_find(const char *source, int lsrc, int from,
+	     const char *what, int lwhat, int case_counts)
+{
+    const unsigned char *src = (const unsigned char *) source;
+    const unsigned char *w = (const unsigned char *) what;
+    int last = lsrc - lwhat;	/* last possible starting offset */
+    int i = from;
+
+    if (lwhat == 0)
+	return from <= lsrc ? from : -1;
+#ifdef SIMD_STRINGS
+    {
+	int found = -1;
+
+#ifdef SIMD_STRINGS_AVX2
+	if (have_avx2())
+	    found = scan_forward_avx2(src, &i, last, w, lwhat, case_counts);
+	if (found < 0)
+#endif
+	    found = scan_forward_sse2(src, &i, last, w, lwhat, case_counts);
+	if (found >= 0)
+	    return found;
+    }
+#endif
+    for (; i <= last; i++)
+	if (bytes_equal(src + i, w, lwhat, case_counts))
+	    return i;
+    return -1;
+}
+
+/* Offset of the last occurrence of WHAT in the LSRC bytes at SOURCE,
+ * or -1 if there is none.
+ */
+static int
+find_backward(const char *source, int lsrc,
+	      const char *what, int lwhat, int case_counts)
+{
+    const unsigned char *src = (const unsigned char *) source;
+    const unsigned char *w = (const unsigned char *) what;
+    int i = lsrc - lwhat;
+
+    if (lwhat == 0)
+	return lsrc;
+#ifdef SIMD_STRINGS
+    {
+	int found = -1;
+
+#ifdef SIMD_STRINGS_AVX2
+	if (have_avx2())
+	    found = scan_backward_avx2(src, &i, w, lwhat, case_counts);
+	if (found < 0)
+#endif
+	    found = scan_backward_sse2(src, &i, w, lwhat, case_counts);
+	if (found >= 0)
+	    return found;
+    }
+#endif
+    for (; i >= 0; i--)
+	if (bytes_equal(src + i, w, lwhat, case_counts))
+	    return i;
+    return -1;
+}
+
+int
+strindex(const char *source, const char *what, int case_counts)
+{
+    return str_find(source, strlen(source), 0,
+			what, strlen(what), case_counts) + 1;
+}
+
+int
+strrindex(const char *source, const char *what, int case_counts)
+{
+    return find_backward(source, strlen(source),
+			 what, strlen(what), case_counts) + 1;
+}
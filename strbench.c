@@ -0,0 +1,292 @@
+/* Check and time the string routines in str_search.c.
+ *
+ * `make strbench' links this with str_search.o alone.  It first checks
+ * mystrcasecmp(), mystrncasecmp(), strindex() and strrindex() against the
+ * plain character-at-a-time loops on random strings, half of them placed
+ * so that their terminating NUL is the last byte before an inaccessible
+ * page; then it times both versions on strings of a few sizes, printing
+ * nanoseconds per call.  The optional argument is the number of random
+ * cases to check (default 1000000).
+ */
+
+#include "my-stdio.h"
+#include "my-stdlib.h"
+#include "my-string.h"
+#include "my-sys-time.h"
+#include "my-unistd.h"
+#include <sys/mman.h>
+
+#include "config.h"
+#include "utils.h"
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+/* The loops the vector code replaced, for checking and comparison. */
+
+static int
+fold(unsigned char c)
+{
+    return (char) (c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c);
+}
+
+static int
+plain_strncasecmp(const char *ss, const char *tt, int n)
+{
+    const unsigned char *s = (const unsigned char *) ss;
+    const unsigned char *t = (const unsigned char *) tt;
+
+    if (!n)
+	return 0;
+    while (fold(*s) == fold(*t++)) {
+	if (!*s++ || !--n)
+	    return 0;
+    }
+    return fold(*s) - fold(*--t);
+}
+
+static int
+plain_strcasecmp(const char *s, const char *t)
+{
+    return plain_strncasecmp(s, t, -1);
+}
+
+static int
+plain_match(const char *s, const char *what, int n, int case_counts)
+{
+    while (n--) {
+	unsigned char a = *s++, b = *what++;
+
+	if (case_counts ? a != b : fold(a) != fold(b))
+	    return 0;
+    }
+    return 1;
+}
+
+static int
+plain_strindex(const char *source, const char *what, int case_counts)
+{
+    int lsrc = strlen(source), lwhat = strlen(what), i;
+
+    for (i = 0; i <= lsrc - lwhat; i++)
+	if (plain_match(source + i, what, lwhat, case_counts))
+	    return i + 1;
+    return 0;
+}
+
+static int
+plain_strrindex(const char *source, const char *what, int case_counts)
+{
+    int lsrc = strlen(source), lwhat = strlen(what), i;
+
+    for (i = lsrc - lwhat; i >= 0; i--)
+	if (plain_match(source + i, what, lwhat, case_counts))
+	    return i + 1;
+    return 0;
+}
+
+/* Random strings. */
+
+#define MAX_LEN		1000
+
+static void
+random_string(char *buf, int len)
+{
+    static const char alphabet[] = "aAbBzZ@[`{ .\200\377";
+
+    while (len--)
+	*buf++ = alphabet[random() % (sizeof(alphabet) - 1)];
+    *buf = '\0';
+}
+
+static int
+random_length(void)
+{
+    return random() % 8 ? random() % 80 : random() % MAX_LEN;
+}
+
+/* Derive from S a string that often shares a long prefix with it. */
+static void
+random_relative(char *buf, const char *s)
+{
+    int len = strlen(s), i;
+
+    strcpy(buf, s);
+    for (i = 0; i < len; i++)
+	if (buf[i] >= 'a' && buf[i] <= 'z' && random() % 2)
+	    buf[i] += 'A' - 'a';
+    switch (random() % 4) {
+    case 0:
+	break;
+    case 1:
+	if (len)
+	    buf[random() % len] = "aB\200"[random() % 3];
+	break;
+    case 2:
+	buf[random() % (len + 1)] = '\0';
+	break;
+    case 3:
+	random_string(buf, random_length());
+	break;
+    }
+}
+
+/* A buffer followed by an inaccessible page. */
+static char *
+guarded_buffer(int size)
+{
+    long page = sysconf(_SC_PAGESIZE);
+    long pages = (size + page - 1) / page;
+    char *p = mmap(0, (pages + 1) * page, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (p == MAP_FAILED || mprotect(p + pages * page, page, PROT_NONE) < 0) {
+	perror("mmap");
+	exit(1);
+    }
+    return p + pages * page;	/* the guard page */
+}
+
+/* Copy S so that its NUL is the last byte before END, sometimes. */
+static const char *
+place(const char *s, char *end)
+{
+    int len = strlen(s);
+
+    if (random() % 2)
+	return s;
+    memcpy(end - len - 1, s, len + 1);
+    return end - len - 1;
+}
+
+static int
+check(long cases)
+{
+    static char a[MAX_LEN + 1], b[MAX_LEN + 1];
+    char *end_a = guarded_buffer(MAX_LEN + 1);
+    char *end_b = guarded_buffer(MAX_LEN + 1);
+    long i;
+    int failures = 0;
+
+    for (i = 0; i < cases && failures < 10; i++) {
+	const char *s, *t;
+	int n, cc;
+
+	random_string(a, random_length());
+	random_relative(b, a);
+	if (random() % 4 == 0 && strlen(b) > 0) {
+	    /* substring search wants a shorter needle, often present */
+	    int len = strlen(b), from = random() % len;
+
+	    memmove(b, b + from, len - from + 1);
+	    b[random() % (len - from + 1)] = '\0';
+	}
+	s = place(a, end_a);
+	t = place(b, end_b);
+	n = random() % (MAX_LEN + 2);
+	cc = random() % 2;
+
+	if (mystrcasecmp(s, t) != plain_strcasecmp(s, t)
+	    || mystrncasecmp(s, t, n) != plain_strncasecmp(s, t, n)
+	    || strindex(s, t, cc) != plain_strindex(s, t, cc)
+	    || strrindex(s, t, cc) != plain_strrindex(s, t, cc)) {
+	    failures++;
+	    printf("MISMATCH: \"%s\" vs \"%s\", n = %d, case_counts = %d\n",
+		   s, t, n, cc);
+	}
+    }
+    printf("%ld cases checked, %d mismatches\n", i, failures);
+    return failures;
+}
+
+/* Timing. */
+
+static volatile int sink;
+
+static double
+now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, 0);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* Nanoseconds per call of F(S, T); runs for about a fifth of a second. */
+static double
+time_calls(int (*f) (const char *, const char *), const char *s,
+	   const char *t)
+{
+    double start = now(), elapsed;
+    long calls = 0, batch = 1, k;
+
+    do {
+	for (k = 0; k < batch; k++)
+	    sink = f(s, t);
+	calls += batch;
+	batch *= 2;
+	elapsed = now() - start;
+    } while (elapsed < 0.2);
+    return elapsed * 1e9 / calls;
+}
+
+static int
+new_index(const char *s, const char *t)
+{
+    return strindex(s, t, 0);
+}
+
+static int
+old_index(const char *s, const char *t)
+{
+    return plain_strindex(s, t, 0);
+}
+
+static void
+benchmark(void)
+{
+    static const int sizes[] = {24, 256, 8 * 1024, 256 * 1024};
+    static const char text[] = "The quick brown fox jumps over the lazy dog. ";
+    unsigned k;
+
+    printf("\nns per call: index(hay, \"Lazy Cat\") with no match,"
+	   " and mystrcasecmp() of hay with an upper-cased copy\n\n");
+    printf("%10s %12s %12s %12s %12s\n", "bytes",
+	   "index() old", "new", "casecmp old", "new");
+    for (k = 0; k < sizeof(sizes) / sizeof(*sizes); k++) {
+	int size = sizes[k], i;
+	char *hay = malloc(size + 1), *upper = malloc(size + 1);
+
+	for (i = 0; i < size; i++) {
+	    hay[i] = text[i % (sizeof(text) - 1)];
+	    upper[i] = (hay[i] >= 'a' && hay[i] <= 'z'
+			? hay[i] - 'a' + 'A' : hay[i]);
+	}
+	hay[size] = upper[size] = '\0';
+	printf("%10d %12.0f %12.0f %12.0f %12.0f\n", size,
+	       time_calls(old_index, hay, "Lazy Cat"),
+	       time_calls(new_index, hay, "Lazy Cat"),
+	       time_calls(plain_strcasecmp, hay, upper),
+	       time_calls(mystrcasecmp, hay, upper));
+	free(hay);
+	free(upper);
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    long cases = 1000000;
+
+    if (argc == 2)
+	cases = atol(argv[1]);
+    else if (argc != 1) {
+	fprintf(stderr, "Usage: %s [cases]\n", argv[0]);
+	exit(1);
+    }
+    if (check(cases))
+	exit(1);
+    benchmark();
+    return 0;
+}
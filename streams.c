@@ -96,8 +96,12 @@ stream_delete_char(Stream * s)
 void
 stream_add_string(Stream * s, const char *string)
 {
-    int len = strlen(string);
+    stream_add_bytes(s, string, strlen(string));
+}
 
+void
+stream_add_bytes(Stream * s, const char *bytes, int len)
+{
     if (s->current + len >= s->buflen) {
 	int newlen = s->buflen * 2;
 
@@ -105,7 +109,7 @@ stream_add_string(Stream * s, const char *string)
 	    newlen = s->current + len + 1;
 	grow(s, newlen, len);
     }
-    strcpy(s->buffer + s->current, string);
+    memcpy(s->buffer + s->current, bytes, len);
     s->current += len;
 }
 
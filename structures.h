@@ -64,13 +64,14 @@ typedef enum {
  * only set in memory.  The original _TYPE values are used in the database
  * file and returned to verbs calling typeof().  This allows the inlines to
  * be extremely cheap (both in space and time) for simple types like oids
- * and ints.
+ * and ints.  Floats are stored directly in the Var, so TYPE_FLOAT carries
+ * no flag and is the same as _TYPE_FLOAT.
  */
 #define TYPE_DB_MASK		0x7f
 #define TYPE_COMPLEX_FLAG	0x80
 
 #define TYPE_STR		(_TYPE_STR | TYPE_COMPLEX_FLAG)
-#define TYPE_FLOAT		(_TYPE_FLOAT | TYPE_COMPLEX_FLAG)
+#define TYPE_FLOAT		_TYPE_FLOAT
 #define TYPE_LIST		(_TYPE_LIST | TYPE_COMPLEX_FLAG)
 
 #define TYPE_ANY ((var_type) -1)	/* wildcard for use in declaring built-ins */
@@ -101,7 +102,7 @@ struct Var {
 	Objid obj;		/* OBJ */
 	enum error err;		/* ERR */
 	Var *list;		/* LIST */
-	double *fnum;		/* FLOAT */
+	double fnum;		/* FLOAT */
     } v;
     var_type type;
 };
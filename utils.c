@@ -34,105 +34,368 @@
 #include "structures.h"
 #include "utils.h"
 
-/*
- * These versions of strcasecmp() and strncasecmp() depend on ASCII.
- * We implement them here because neither one is in the ANSI standard.
+/* Deferred freeing.
+ *
+ * Dropping the last reference to a huge list (or a big tree of small ones)
+ * would otherwise free the whole thing on the spot, stalling every other
+ * task and connection while it happens.  Instead, lists of at least
+ * DEFERRED_FREE_LENGTH elements, and any list met after DEFERRED_FREE_WORK
+ * values have already been freed in one go, are put on a queue that
+ * free_deferred_values() works through a slice at a time from the main
+ * loop.  A queued list is chained through its (now unused) length slot,
+ * the length having moved to its (equally unused) refcount, where it is
+ * counted down as the elements are freed from the end; the rest of the
+ * header is left alone, since myfree() needs it to find the block.  Once
+ * DEFERRED_FREE_CAP bytes of list storage are waiting, lists are freed
+ * immediately again.
  */
 
-static const char cmap[] =
-"\000\001\002\003\004\005\006\007\010\011\012\013\014\015\016\017"
-"\020\021\022\023\024\025\026\027\030\031\032\033\034\035\036\037"
-"\040\041\042\043\044\045\046\047\050\051\052\053\054\055\056\057"
-"\060\061\062\063\064\065\066\067\070\071\072\073\074\075\076\077"
-"\100\141\142\143\144\145\146\147\150\151\152\153\154\155\156\157"
-"\160\161\162\163\164\165\166\167\170\171\172\133\134\135\136\137"
-"\140\141\142\143\144\145\146\147\150\151\152\153\154\155\156\157"
-"\160\161\162\163\164\165\166\167\170\171\172\173\174\175\176\177"
-"\200\201\202\203\204\205\206\207\210\211\212\213\214\215\216\217"
-"\220\221\222\223\224\225\226\227\230\231\232\233\234\235\236\237"
-"\240\241\242\243\244\245\246\247\250\251\252\253\254\255\256\257"
-"\260\261\262\263\264\265\266\267\270\271\272\273\274\275\276\277"
-"\300\301\302\303\304\305\306\307\310\311\312\313\314\315\316\317"
-"\320\321\322\323\324\325\326\327\330\331\332\333\334\335\336\337"
-"\340\341\342\343\344\345\346\347\350\351\352\353\354\355\356\357"
-"\360\361\362\363\364\365\366\367\370\371\372\373\374\375\376\377";
+#define DEFERRED_FREE_LENGTH	65536
+#define DEFERRED_FREE_WORK	65536
+#define DEFERRED_FREE_CAP	(64 * 1024 * 1024)
 
-int
-mystrcasecmp(const char *ss, const char *tt)
+#define deferred_next(l)	((l)[0].v.list)
+#define deferred_left(l)	refcount(l)
+
+static Var *deferred_head = 0, *deferred_tail = 0;
+static unsigned deferred_count = 0;
+static size_t deferred_bytes = 0, deferred_peak = 0;
+
+static unsigned free_work = 0;	/* values freed since free_depth was 0 */
+static int free_depth = 0;
+
+#ifdef USE_RECLAIMER_THREAD
+
+#include <pthread.h>
+#include "my-unistd.h"
+
+/* The reclaimer thread.
+ *
+ * With USE_RECLAIMER_THREAD, defer_free() first tries to hand a dead list
+ * of at least DEFERRED_FREE_LENGTH elements to the reclaimer thread.  (The
+ * small lists met past DEFERRED_FREE_WORK stay on the main queue: handing
+ * them over one at a time costs the main thread about as much as freeing
+ * them would, the two threads sharing one malloc arena.)  Only the main
+ * thread may touch a reference count that anybody else might be touching,
+ * so the reclaimer frees just the strings and lists that the dead list
+ * holds the only reference to (a count of 1 can't change under it: nobody
+ * else can reach the value), and passes everything else back in
+ * reclaim_returned[] for free_deferred_values() to free_var() in the main
+ * thread.  The blocks it frees are settled with the allocator's books from
+ * the main thread, too.
+ * A forked checkpointer has no reclaimer and frees things itself.
+ */
+
+static pthread_mutex_t reclaim_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t reclaim_wake = PTHREAD_COND_INITIALIZER;
+static pid_t reclaim_pid = 0;	/* process the thread runs in, if any */
+static int reclaim_failed = 0;
+
+/* All of these are guarded by reclaim_lock. */
+static Var *reclaim_head = 0, *reclaim_tail = 0;
+static unsigned reclaim_count = 0;
+static size_t reclaim_bytes = 0;
+static unsigned reclaimed_num[2];	/* strings, lists */
+static size_t reclaimed_bytes[2];
+static Var *reclaim_returned = 0;
+static int reclaim_returned_len = 0, reclaim_returned_max = 0;
+
+/* Owned by the main thread: shared values waiting for free_var(). */
+static Var *returned = 0;
+static int returned_len = 0, returned_next = 0;
+
+struct reclaim_batch {
+    unsigned num[2];
+    size_t bytes[2];
+    Var *returned;
+    int returned_len, returned_max;
+    struct frame {
+	Var *list;
+	int i;
+    } *stack;
+    int depth, max_depth;
+};
+
+/* If there's no memory even for this, v's reference is simply leaked. */
+static int
+batch_return(struct reclaim_batch *b, Var v)
 {
-    register const unsigned char *s = (const unsigned char *) ss;
-    register const unsigned char *t = (const unsigned char *) tt;
+    if (b->returned_len == b->returned_max) {
+	int max = b->returned_max ? 2 * b->returned_max : 1024;
+	Var *r = realloc(b->returned, max * sizeof(Var));
 
-    if (s == t) {
-	return 0;
-    }
-    while (cmap[*s] == cmap[*t++]) {
-	if (!*s++)
+	if (!r)
 	    return 0;
+	b->returned = r;
+	b->returned_max = max;
     }
-    return (cmap[*s] - cmap[*--t]);
+    b->returned[b->returned_len++] = v;
+    return 1;
 }
 
-int
-mystrncasecmp(const char *ss, const char *tt, int n)
+static void
+tear_down(Var * list, struct reclaim_batch *b)
+{
+    b->depth = 0;
+    b->stack[0].list = list;
+    b->stack[0].i = deferred_left(list);
+    while (b->depth >= 0) {
+	struct frame *f = &b->stack[b->depth];
+	Var v;
+
+	if (f->i == 0) {
+	    b->bytes[1] += myfree_detached(f->list, M_LIST);
+	    b->num[1]++;
+	    b->depth--;
+	    continue;
+	}
+	v = f->list[f->i--];
+	if (v.type == TYPE_STR) {
+	    if (refcount(v.v.str) == 1) {
+		b->bytes[0] += myfree_detached((void *) v.v.str, M_STRING);
+		b->num[0]++;
+		continue;
+	    }
+	} else if (v.type == TYPE_LIST) {
+	    if (refcount(v.v.list) == 1) {
+		if (b->depth + 1 == b->max_depth) {
+		    int max = 2 * b->max_depth;
+		    struct frame *st = realloc(b->stack, max * sizeof(*st));
+
+		    if (!st) {
+			batch_return(b, v);	/* let the main thread do it */
+			continue;
+		    }
+		    b->stack = st;
+		    b->max_depth = max;
+		}
+		b->depth++;
+		b->stack[b->depth].list = v.v.list;
+		b->stack[b->depth].i = v.v.list[0].v.num;
+		continue;
+	    }
+	} else
+	    continue;
+	batch_return(b, v);
+    }
+}
+
+static void *
+reclaimer(void *ignored)
 {
-    const unsigned char *s = (const unsigned char *) ss;
-    const unsigned char *t = (const unsigned char *) tt;
+    struct reclaim_batch b;
+
+    memset(&b, 0, sizeof(b));
+    b.max_depth = 64;
+    b.stack = malloc(b.max_depth * sizeof(*b.stack));
+
+    pthread_mutex_lock(&reclaim_lock);
+    for (;;) {
+	Var *list;
+	size_t bytes;
+	int k;
+
+	while (!reclaim_head)
+	    pthread_cond_wait(&reclaim_wake, &reclaim_lock);
+	list = reclaim_head;
+	if (!(reclaim_head = deferred_next(list)))
+	    reclaim_tail = 0;
+	pthread_mutex_unlock(&reclaim_lock);
+
+	bytes = (deferred_left(list) + 1) * sizeof(Var);
+	tear_down(list, &b);
+
+	pthread_mutex_lock(&reclaim_lock);
+	reclaim_count--;
+	reclaim_bytes -= bytes;
+	for (k = 0; k < 2; k++) {
+	    reclaimed_num[k] += b.num[k];
+	    reclaimed_bytes[k] += b.bytes[k];
+	    b.num[k] = b.bytes[k] = 0;
+	}
+	if (b.returned_len) {
+	    if (!reclaim_returned) {
+		reclaim_returned = b.returned;
+		reclaim_returned_len = b.returned_len;
+		reclaim_returned_max = b.returned_max;
+		b.returned = 0;
+		b.returned_max = 0;
+	    } else {
+		int i;
+
+		for (i = 0; i < b.returned_len; i++) {
+		    if (reclaim_returned_len == reclaim_returned_max) {
+			int max = 2 * reclaim_returned_max;
+			Var *r = realloc(reclaim_returned, max * sizeof(Var));
+
+			if (!r)
+			    break;	/* as in batch_return() */
+			reclaim_returned = r;
+			reclaim_returned_max = max;
+		    }
+		    reclaim_returned[reclaim_returned_len++] = b.returned[i];
+		}
+	    }
+	    b.returned_len = 0;
+	}
+    }
+    return 0;
+}
 
-    if (!n || ss == tt)
+static int
+reclaim(Var * list)
+{
+    size_t bytes = (list[0].v.num + 1) * sizeof(Var);
+
+    if (reclaim_failed || alloc_profile_active())
 	return 0;
-    while (cmap[*s] == cmap[*t++]) {
-	if (!*s++ || !--n)
+    if (!reclaim_pid) {
+	pthread_t t;
+
+	if (pthread_create(&t, 0, reclaimer, 0) != 0) {
+	    errlog("RECLAIM: Can't start reclaimer thread; freeing "
+		   "in the main loop instead\n");
+	    reclaim_failed = 1;
 	    return 0;
+	}
+	pthread_detach(t);
+	reclaim_pid = getpid();
+    } else if (reclaim_pid != getpid())
+	return 0;
+
+    pthread_mutex_lock(&reclaim_lock);
+    if (reclaim_bytes + bytes > RECLAIM_QUEUE_BYTES) {
+	pthread_mutex_unlock(&reclaim_lock);
+	return 0;
     }
-    return (cmap[*s] - cmap[*--t]);
+    deferred_left(list) = list[0].v.num;
+    deferred_next(list) = 0;
+    if (reclaim_tail)
+	deferred_next(reclaim_tail) = list;
+    else
+	reclaim_head = list;
+    reclaim_tail = list;
+    reclaim_count++;
+    reclaim_bytes += bytes;
+    if (deferred_bytes + reclaim_bytes > deferred_peak)
+	deferred_peak = deferred_bytes + reclaim_bytes;
+    pthread_cond_signal(&reclaim_wake);
+    pthread_mutex_unlock(&reclaim_lock);
+    return 1;
 }
 
-int
-verbcasecmp(const char *verb, const char *word)
+/* Settle the reclaimer's frees with the allocator and pick up whatever it
+ * has handed back.  Returns the number of values waiting in returned[].
+ */
+static int
+collect_reclaimed(void)
 {
-    const unsigned char *w;
-    const unsigned char *v = (const unsigned char *) verb;
-    enum {
-	none, inner, end
-    } star;
+    unsigned num[2];
+    size_t bytes[2];
+    int k;
 
-    if (verb == word) {
+    if (!reclaim_pid || reclaim_pid != getpid())
+	return 0;
+    pthread_mutex_lock(&reclaim_lock);
+    for (k = 0; k < 2; k++) {
+	num[k] = reclaimed_num[k];
+	bytes[k] = reclaimed_bytes[k];
+	reclaimed_num[k] = reclaimed_bytes[k] = 0;
+    }
+    if (returned_next == returned_len && reclaim_returned) {
+	free(returned);
+	returned = reclaim_returned;
+	returned_len = reclaim_returned_len;
+	returned_next = 0;
+	reclaim_returned = 0;
+	reclaim_returned_len = reclaim_returned_max = 0;
+    }
+    pthread_mutex_unlock(&reclaim_lock);
+
+    myfree_settle(M_STRING, num[0], bytes[0]);
+    myfree_settle(M_LIST, num[1], bytes[1]);
+    return returned_len - returned_next;
+}
+
+#endif				/* USE_RECLAIMER_THREAD */
+
+static int
+defer_free(Var * list)
+{
+    size_t bytes = (list[0].v.num + 1) * sizeof(Var);
+
+#ifdef USE_RECLAIMER_THREAD
+    if (list[0].v.num >= DEFERRED_FREE_LENGTH && reclaim(list))
 	return 1;
+#endif
+    if (deferred_bytes + bytes > DEFERRED_FREE_CAP)
+	return 0;
+    deferred_left(list) = list[0].v.num;
+    deferred_next(list) = 0;
+    if (deferred_tail)
+	deferred_next(deferred_tail) = list;
+    else
+	deferred_head = list;
+    deferred_tail = list;
+    deferred_count++;
+    deferred_bytes += bytes;
+    if (deferred_bytes > deferred_peak)
+	deferred_peak = deferred_bytes;
+    return 1;
+}
+
+int
+free_deferred_values(void)
+{
+    int more = 0;
+
+    free_depth++;
+#ifdef USE_RECLAIMER_THREAD
+    if (collect_reclaimed()) {
+	while (returned_next < returned_len && free_work < DEFERRED_FREE_WORK) {
+	    free_var(returned[returned_next++]);
+	    free_work++;
+	}
+	more = returned_next < returned_len;
     }
-    while (*v) {
-	w = (const unsigned char *) word;
-	star = none;
-	while (1) {
-	    while (*v == '*') {
-		v++;
-		star = (!*v || *v == ' ') ? end : inner;
-	    }
-	    if (!*v || *v == ' ' || !*w || cmap[*w] != cmap[*v])
-		break;
-	    w++;
-	    v++;
+#endif
+    while (deferred_head && free_work < DEFERRED_FREE_WORK) {
+	Var *list = deferred_head;
+	int n = deferred_left(list);
+
+	while (n > 0 && free_work < DEFERRED_FREE_WORK) {
+	    free_var(list[n--]);
+	    free_work++;
+	    deferred_bytes -= sizeof(Var);
+	}
+	deferred_left(list) = n;
+	if (n == 0) {
+	    if (!(deferred_head = deferred_next(list)))
+		deferred_tail = 0;
+	    deferred_count--;
+	    deferred_bytes -= sizeof(Var);
+	    myfree(list, M_LIST);
 	}
-	if (!*w ? (star != none || !*v || *v == ' ')
-	    : (star == end))
-	    return 1;
-	while (*v && *v != ' ')
-	    v++;
-	while (*v == ' ')
-	    v++;
     }
-    return 0;
+    if (--free_depth == 0)
+	free_work = 0;
+    return more || deferred_head != 0;
 }
 
-unsigned
-str_hash(const char *s)
+void
+deferred_free_usage(unsigned *count, size_t * bytes, size_t * peak)
 {
-    register unsigned ans = 0;
-
-    while (*s) {
-	ans = (ans << 3) + (ans >> 28) + cmap[(unsigned char) *s++];
+    *count = deferred_count;
+    *bytes = deferred_bytes;
+    *peak = deferred_peak;
+#ifdef USE_RECLAIMER_THREAD
+    if (reclaim_pid && reclaim_pid == getpid()) {
+	pthread_mutex_lock(&reclaim_lock);
+	*count += reclaim_count;
+	*bytes += reclaim_bytes;
+	pthread_mutex_unlock(&reclaim_lock);
     }
-    return ans;
+#endif
 }
 
 void
@@ -149,15 +412,19 @@ complex_free_var(Var v)
 	if (delref(v.v.list) == 0) {
 	    Var *pv;
 
-	    for (i = v.v.list[0].v.num, pv = v.v.list + 1; i > 0; i--, pv++)
+	    i = v.v.list[0].v.num;
+	    if ((i >= DEFERRED_FREE_LENGTH || free_work >= DEFERRED_FREE_WORK)
+		&& defer_free(v.v.list))
+		break;
+	    free_depth++;
+	    free_work += i;
+	    for (pv = v.v.list + 1; i > 0; i--, pv++)
 		free_var(*pv);
 	    myfree(v.v.list, M_LIST);
+	    if (--free_depth == 0)
+		free_work = 0;
 	}
 	break;
-    case TYPE_FLOAT:
-	if (delref(v.v.fnum) == 0)
-	    myfree(v.v.fnum, M_FLOAT);
-	break;
     }
 }
 
@@ -171,9 +438,6 @@ complex_var_ref(Var v)
     case TYPE_LIST:
 	addref(v.v.list);
 	break;
-    case TYPE_FLOAT:
-	addref(v.v.fnum);
-	break;
     }
     return v;
 }
@@ -195,9 +459,6 @@ complex_var_dup(Var v)
 	}
 	v.v.list = newlist.v.list;
 	break;
-    case TYPE_FLOAT:
-	v = new_float(*v.v.fnum);
-	break;
     }
     return v;
 }
@@ -215,9 +476,6 @@ var_refcount(Var v)
     case TYPE_LIST:
 	return refcount(v.v.list);
 	break;
-    case TYPE_FLOAT:
-	return refcount(v.v.fnum);
-	break;
     }
     return 1;
 }
@@ -226,7 +484,7 @@ int
 is_true(Var v)
 {
     return ((v.type == TYPE_INT && v.v.num != 0)
-	    || (v.type == TYPE_FLOAT && *v.v.fnum != 0.0)
+	    || (v.type == TYPE_FLOAT && v.v.fnum != 0.0)
 	    || (v.type == TYPE_STR && v.v.str && *v.v.str != '\0')
 	    || (v.type == TYPE_LIST && v.v.list[0].v.num != 0));
 }
@@ -247,10 +505,17 @@ equality(Var lhs, Var rhs, int case_matters)
 	case TYPE_ERR:
 	    return lhs.v.err == rhs.v.err;
 	case TYPE_STR:
+#ifdef MEMO_STRLEN
+	    if (memo_strlen(lhs.v.str) != memo_strlen(rhs.v.str))
+		return 0;
+	    return str_bytes_equal(lhs.v.str, rhs.v.str,
+				   memo_strlen(lhs.v.str), case_matters);
+#else
 	    if (case_matters)
 		return !strcmp(lhs.v.str, rhs.v.str);
 	    else
 		return !mystrcasecmp(lhs.v.str, rhs.v.str);
+#endif
 	case TYPE_LIST:
 	    if (lhs.v.list[0].v.num != rhs.v.list[0].v.num)
 		return 0;
@@ -276,46 +541,21 @@ equality(Var lhs, Var rhs, int case_matters)
 void
 stream_add_strsub(Stream *str, const char *source, const char *what, const char *with, int case_counts)
 {
+    int lsrc = strlen(source);
     int lwhat = strlen(what);
+    int from = 0, found;
 
-    while (*source) {
-	if (!(case_counts ? strncmp(source, what, lwhat)
-	      : mystrncasecmp(source, what, lwhat))) {
-	    stream_add_string(str, with);
-	    source += lwhat;
-	} else
-	    stream_add_char(str, *source++);
-    }
-}
-
-int
-strindex(const char *source, const char *what, int case_counts)
-{
-    const char *s, *e;
-    int lwhat = strlen(what);
-
-    for (s = source, e = source + strlen(source) - lwhat; s <= e; s++) {
-	if (!(case_counts ? strncmp(s, what, lwhat)
-	      : mystrncasecmp(s, what, lwhat))) {
-	    return s - source + 1;
-	}
+    if (lwhat == 0) {
+	stream_add_string(str, source);
+	return;
     }
-    return 0;
-}
-
-int
-strrindex(const char *source, const char *what, int case_counts)
-{
-    const char *s;
-    int lwhat = strlen(what);
-
-    for (s = source + strlen(source) - lwhat; s >= source; s--) {
-	if (!(case_counts ? strncmp(s, what, lwhat)
-	      : mystrncasecmp(s, what, lwhat))) {
-	    return s - source + 1;
-	}
+    while ((found = str_find(source, lsrc, from,
+			     what, lwhat, case_counts)) >= 0) {
+	stream_add_bytes(str, source + from, found - from);
+	stream_add_string(str, with);
+	from = found + lwhat;
     }
-    return 0;
+    stream_add_bytes(str, source + from, lsrc - from);
 }
 
 Var
@@ -360,9 +600,6 @@ value_bytes(Var v)
     case TYPE_STR:
 	size += memo_strlen(v.v.str) + 1;
 	break;
-    case TYPE_FLOAT:
-	size += sizeof(double);
-	break;
     case TYPE_LIST:
 	len = v.v.list[0].v.num;
 	size += sizeof(Var);	/* for the `length' element */
@@ -22,6 +22,7 @@
 
 #include "config.h"
 #include "execute.h"
+#include "storage.h"
 #include "streams.h"
 
 #undef MAX
@@ -34,11 +35,41 @@
 extern int mystrcasecmp(const char *, const char *);
 extern int mystrncasecmp(const char *, const char *, int);
 
+/* True iff the N bytes at S and T are equal (ignoring case if !CASE_COUNTS). */
+extern int str_bytes_equal(const char *s, const char *t, int n,
+			   int case_counts);
+/* Offset of the first occurrence of the LWHAT bytes at WHAT in the LSRC
+ * bytes at SOURCE that starts at or after FROM, or -1 if there is none.
+ */
+extern int str_find(const char *source, int lsrc, int from,
+		    const char *what, int lwhat, int case_counts);
+
 extern int verbcasecmp(const char *verb, const char *word);
 
 extern unsigned str_hash(const char *);
+extern unsigned str_hash_span(const char *, int);
+
+#ifdef MEMO_STRHASH
+/* str_hash() of a string allocated as M_STRING (e.g., any MOO string
+ * value), computed once and then kept with the string.
+ */
+static inline unsigned
+str_hash_memo(const char *s)
+{
+    unsigned h = memo_strhash(s);
+
+    if (!h)
+	h = memo_strhash(s) = str_hash(s);
+    return h;
+}
+#else
+#define str_hash_memo(X)	str_hash(X)
+#endif /* MEMO_STRHASH */
 
 extern void complex_free_var(Var);
+extern int free_deferred_values(void);
+extern void deferred_free_usage(unsigned *count, size_t * bytes,
+				size_t * peak);
 extern Var complex_var_ref(Var);
 extern Var complex_var_dup(Var);
 extern int var_refcount(Var);
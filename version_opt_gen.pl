@@ -55,6 +55,9 @@ my @options =
 		BYTECODE_REDUCE_REF
 		STRING_INTERNING
 		MEMO_STRLEN
+		MEMO_STRHASH
+		USE_SLAB_ALLOCATOR
+		USE_RECLAIMER_THREAD
 	      )],
 
    # input options
@@ -77,6 +80,8 @@ my @options =
 		MIN_LIST_CONCAT_LIMIT
 		DEFAULT_MAX_STRING_CONCAT
 		MIN_STRING_CONCAT_LIMIT
+		DEFAULT_MAX_VERB_CACHE_BYTES
+		MIN_VERB_CACHE_BYTES
 	      )],
   );
 
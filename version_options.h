@@ -94,6 +94,21 @@ _DDEF("MEMO_STRLEN")
 #else
 _DNDEF("MEMO_STRLEN")
 #endif
+#ifdef MEMO_STRHASH
+_DDEF("MEMO_STRHASH")
+#else
+_DNDEF("MEMO_STRHASH")
+#endif
+#ifdef USE_SLAB_ALLOCATOR
+_DDEF("USE_SLAB_ALLOCATOR")
+#else
+_DNDEF("USE_SLAB_ALLOCATOR")
+#endif
+#ifdef USE_RECLAIMER_THREAD
+_DDEF("USE_RECLAIMER_THREAD")
+#else
+_DNDEF("USE_RECLAIMER_THREAD")
+#endif
 #ifdef LOG_COMMANDS
 _DDEF("LOG_COMMANDS")
 #else
@@ -169,3 +184,13 @@ _DINT1(MIN_STRING_CONCAT_LIMIT)
 #else
 _DNDEF("MIN_STRING_CONCAT_LIMIT")
 #endif
+#ifdef DEFAULT_MAX_VERB_CACHE_BYTES
+_DINT1(DEFAULT_MAX_VERB_CACHE_BYTES)
+#else
+_DNDEF("DEFAULT_MAX_VERB_CACHE_BYTES")
+#endif
+#ifdef MIN_VERB_CACHE_BYTES
+_DINT1(MIN_VERB_CACHE_BYTES)
+#else
+_DNDEF("MIN_VERB_CACHE_BYTES")
+#endif